@@ -0,0 +1,481 @@
+/*
+ * Canonical kernels for the vectorization audit (see tools/vecaudit.sh).
+ *
+ * Each kernel is selected with `-D AUDIT_<NAME>`, and exposes one function,
+ * `audit_kernel`, implemented either with range adapters, or - when
+ * `AUDIT_REFERENCE` is defined - with the equivalent raw loop.
+ */
+
+#include <functional>
+
+#include "range.hpp"
+
+#define AUDIT_KERNEL extern "C"
+
+static inline float pow2( float v )
+{
+    return v * v;
+}
+
+#if defined( AUDIT_MAP )
+
+AUDIT_KERNEL void audit_kernel( const float *in, float *out, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = pow2( in[i] );
+#else
+    range( in, in + n )
+        .map( pow2 )
+        .copyTo( range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_AS )
+
+AUDIT_KERNEL void audit_kernel( const int *in, float *out, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = static_cast<float>( in[i] );
+#else
+    range( in, in + n )
+        .as<float>()
+        .copyTo( range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_AS_MAP )
+
+AUDIT_KERNEL void audit_kernel( const int *in, float *out, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = pow2( static_cast<float>( in[i] ) );
+#else
+    range( in, in + n )
+        .as<float>()
+        .map( pow2 )
+        .copyTo( range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_COPY_TO )
+
+AUDIT_KERNEL void audit_kernel( const float *in, float *out, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = in[i];
+#else
+    range( in, in + n )
+        .copyTo( range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_IOTA )
+
+AUDIT_KERNEL void audit_kernel( int *out, int n )
+{
+#if defined( AUDIT_REFERENCE )
+    for ( int i = 0; i < n; ++i )
+        out[i] = i * 3;
+#else
+    iota( n )
+        .map( []( int e ) { return e * 3; } )
+        .copyTo( range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_EACH )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+    float acc = 0.0f;
+#if defined( AUDIT_REFERENCE )
+    for ( size_t i = 0; i < n; ++i )
+        acc += in[i];
+#else
+    range( in, in + n )
+        .each( [&]( float e ) { acc += e; } );
+#endif
+    return acc;
+}
+
+#elif defined( AUDIT_REDUCE )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = in[0];
+    for ( size_t i = 1; i < n; ++i )
+        acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .reduce( []( float a, float e ) { return a + e; } );
+#endif
+}
+
+#elif defined( AUDIT_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n; ++i )
+        acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_DROP_TAKE )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 1; i < n / 2; ++i )
+        acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .take( n / 2 )
+        .drop()
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_MAP_CAPTURE )
+
+// Lambdas capturing state by reference (here 24 bytes), as in most user code.
+AUDIT_KERNEL void audit_kernel( const float *in, float *out, size_t n, float a, float b, float c )
+{
+#if defined( AUDIT_REFERENCE )
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = in[i] * a + b * c;
+#else
+    range( in, in + n )
+        .map( [&]( float e ) { return e * a + b * c; } )
+        .copyTo( range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_MAP_FOLD_CAPTURE )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n, float a, float b, float c )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n; ++i )
+        acc += in[i] * a + b * c;
+    return acc;
+#else
+    return range( in, in + n )
+        .map( [&]( float e ) { return e * a + b * c; } )
+        .fold( []( float acc, float e ) { return acc + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_MAP_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const int *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n; ++i )
+        acc += pow2( static_cast<float>( in[i] ) );
+    return acc;
+#else
+    return range( in, in + n )
+        .as<float>()
+        .map( pow2 )
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_FLATTEN_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n - n % 16; ++i )
+        acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .tile( 16 )
+        .flatten()
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_FILTER_FOLD )
+
+AUDIT_KERNEL int audit_kernel( const int *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    int acc = 0;
+    for ( size_t i = 0; i < n; ++i )
+        acc += in[i] > 10 ? in[i] : 0;
+    return acc;
+#else
+    return range( in, in + n )
+        .filter( []( int e ) { return e > 10; } )
+        .fold( []( int a, int e ) { return a + e; }, 0 );
+#endif
+}
+
+#elif defined( AUDIT_SCAN )
+
+AUDIT_KERNEL int audit_kernel( const int *in, int *out, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    int acc = 0;
+    for ( size_t i = 0; i < n; ++i )
+        out[i] = acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .inclusiveScan( std::plus<>(), range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_SELECT )
+
+AUDIT_KERNEL size_t audit_kernel( const float *in, const float *other, float *out, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    size_t count = 0;
+    for ( size_t i = 0; i < n; ++i ) {
+        out[count] = other[i];
+        count += in[i] > 0.5f;
+    }
+    return count;
+#else
+    return range( in, in + n )
+        .select( []( float e ) { return e > 0.5f; } )
+        .compactTo( range( other, other + n ), range( out, out + n ) );
+#endif
+}
+
+#elif defined( AUDIT_ANY_RANGE )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n; ++i )
+        acc += in[i] * 0.5f;
+    return acc;
+#else
+    AnyRange<float> erased = range( in, in + n )
+        .map( []( float e ) { return e * 0.5f; } );
+    return erased.fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_TAIL_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = n - n / 2; i < n; ++i )
+        acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .tail( n / 2 )
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_TILE_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t t = 0; t < n / 16; ++t ) {
+        float tile = 0.0f;
+        for ( size_t i = 0; i < 16; ++i )
+            tile += in[t * 16 + i];
+        acc += tile;
+    }
+    return acc;
+#else
+    float acc = 0.0f;
+    range( in, in + n )
+        .tile( 16 )
+        .each( [&acc]( auto tile ) { acc += tile.fold( []( float a, float e ) { return a + e; }, 0.0f ); } );
+    return acc;
+#endif
+}
+
+#elif defined( AUDIT_SPLIT )
+
+AUDIT_KERNEL size_t audit_kernel( const int *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    size_t count = 0;
+    for ( size_t i = 0; i < n; ++i )
+        count += in[i] != 0;
+    return count;
+#else
+    size_t count = 0;
+    range( in, in + n )
+        .split( 0 )
+        .each( [&count]( auto part ) { count += static_cast<size_t>( part.size() ); } );
+    return count;
+#endif
+}
+
+#elif defined( AUDIT_JOIN_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n - n % 16; ++i )
+        acc += in[i];
+    return acc + ( n / 16 - 1 ) * 1.0f;
+#else
+    return range( in, in + n )
+        .tile( 16 )
+        .join( 1.0f )
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_CACHE_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n; ++i )
+        acc += pow2( in[i] );
+    return acc;
+#else
+    return range( in, in + n )
+        .map( pow2 )
+        .cache( n )
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_GATHER_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *in, const float *other, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 0; i < n; ++i )
+        if ( in[i] > 0.5f )
+            acc += other[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .select( []( float e ) { return e > 0.5f; } )
+        .gather( range( other, other + n ) )
+        .fold( []( float a, float e ) { return a + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_MERGE_FOLD )
+
+// Sorted inputs of n elements each.
+AUDIT_KERNEL float audit_kernel( const float *a, const float *b, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    size_t i = 0, j = 0;
+    while ( i < n && j < n )
+        acc += b[j] < a[i] ? b[j++] : a[i++];
+    while ( i < n )
+        acc += a[i++];
+    while ( j < n )
+        acc += b[j++];
+    return acc;
+#else
+    return merge( range( a, a + n ), range( b, b + n ) )
+        .fold( []( float acc, float e ) { return acc + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_INTERSECTION_FOLD )
+
+AUDIT_KERNEL float audit_kernel( const float *a, const float *b, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    size_t i = 0, j = 0;
+    while ( i < n && j < n ) {
+        if ( a[i] < b[j] ) {
+            ++i;
+        } else if ( b[j] < a[i] ) {
+            ++j;
+        } else {
+            acc += a[i++];
+            ++j;
+        }
+    }
+    return acc;
+#else
+    return setIntersection( range( a, a + n ), range( b, b + n ) )
+        .fold( []( float acc, float e ) { return acc + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_KWAY_FOLD )
+
+// Four sorted runs of n / 4 elements.
+AUDIT_KERNEL float audit_kernel( const float *in, size_t n )
+{
+    const size_t m = n / 4;
+#if defined( AUDIT_REFERENCE )
+    size_t pos[4] = { 0, m, 2 * m, 3 * m };
+    float acc = 0.0f;
+    for ( size_t left = 4 * m; left > 0; --left ) {
+        size_t w = 4;
+        for ( size_t r = 0; r < 4; ++r )
+            if ( pos[r] < ( r + 1 ) * m && ( w == 4 || in[pos[r]] < in[pos[w]] ) )
+                w = r;
+        acc += in[pos[w]++];
+    }
+    return acc;
+#else
+    std::vector<GenericRange<const float *> > runs;
+    for ( size_t r = 0; r < 4; ++r )
+        runs.push_back( range( in + r * m, in + ( r + 1 ) * m ) );
+    return kwayMerge( runs )
+        .fold( []( float acc, float e ) { return acc + e; }, 0.0f );
+#endif
+}
+
+#elif defined( AUDIT_INCREMENTAL )
+
+// Build the tree, then reduce a sub-range.
+AUDIT_KERNEL float audit_kernel( float *in, size_t n )
+{
+#if defined( AUDIT_REFERENCE )
+    float acc = 0.0f;
+    for ( size_t i = 1; i < n; ++i )
+        acc += in[i];
+    return acc;
+#else
+    return range( in, in + n )
+        .incremental( std::plus<float>() )
+        .drop()
+        .reduce();
+#endif
+}
+
+#else
+#error "No audit kernel selected, define AUDIT_<NAME>."
+#endif
@@ -3,6 +3,9 @@
 #include <cmath>
 #include <ctime>
 #include <string>
+#include <functional>
+#include <chrono>
+#include <memory>
 
 #include "range.hpp"
 
@@ -44,6 +47,113 @@ void piped_calls(int *v, size_t length)
     }
 }
 
+#elif defined( PROGRAM_SCAN )
+
+int scan_offsets(const int *counts, int *offsets, size_t length)
+{
+    return range( counts, counts + length )
+        .exclusiveScan( std::plus<>(), 0, range( offsets, offsets + length ) );
+}
+
+#elif defined( PROGRAM_SELECT )
+
+size_t select_compact(const float *x, const float *y, float *out, size_t length)
+{
+    auto sel = range( x, x + length )
+        .select( []( float e ) { return e > 0.5f; } );
+    return sel.compactTo( range( y, y + length ), range( out, out + length ) );
+}
+
+#elif defined( PROGRAM_ANYRANGE_BENCH )
+
+/*
+ * Compare type-erased AnyRange against the fully templated pipeline.
+ *
+ * Erased consumers are kept out of line, as if they lived in another
+ * compilation unit.
+ */
+
+__attribute__((noinline)) float erased_fold(AnyRange<float> r)
+{
+    return r.fold( []( float acc, float e ) { return acc + e; }, 0.0f );
+}
+
+// range-for steps the erased iterator per element, several times slower
+// than the block loop of fold - shown here as what consumers should avoid.
+__attribute__((noinline)) float erased_loop(AnyRange<float> r)
+{
+    float acc = 0.0f;
+    for ( auto e : r ) {
+        acc += e;
+    }
+    return acc;
+}
+
+struct Candidate {
+    const char *name;
+    std::function<float()> fn;
+    double best; // ns/element
+};
+
+// Best of several timed batches per candidate, after an untimed warm-up
+// run. Batches go round-robin over the candidates, so results depend
+// neither on the order in which they are listed, nor on a noisy period.
+void bench(std::vector<Candidate> &candidates, size_t elements)
+{
+    const int batches = 7, repeats = 10;
+    volatile float sink = 0.0f;
+
+    for ( auto &c : candidates ) {
+        sink = sink + c.fn();
+    }
+
+    for ( int b = 0; b < batches; ++b ) {
+        for ( auto &c : candidates ) {
+            auto start = std::chrono::steady_clock::now();
+            for ( int i = 0; i < repeats; ++i ) {
+                sink = sink + c.fn();
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            auto ns = std::chrono::duration<double, std::nano>( end - start ).count() / ( repeats * elements );
+            if ( b == 0 || ns < c.best )
+                c.best = ns;
+        }
+    }
+
+    for ( auto &c : candidates ) {
+        std::cout << c.name << ": " << c.best << " ns/element" << std::endl;
+    }
+}
+
+int main( int, char *[] ) {
+    std::vector<int> v( 1 << 22 );
+    for ( size_t i = 0; i < v.size(); ++i ) {
+        v[i] = static_cast<int>( i % 1000 );
+    }
+
+    auto pipeline = range( v )
+        .map( []( int e ) { return static_cast<float>( e ) * 0.5f + 1.0f; } );
+
+    std::vector<Candidate> candidates = {
+        { "raw loop      ", [&]() {
+            float acc = 0.0f;
+            for ( auto e : v ) {
+                acc += static_cast<float>( e ) * 0.5f + 1.0f;
+            }
+            return acc;
+        }, 0.0 },
+        { "templated fold", [&]() {
+            return pipeline.fold( []( float acc, float e ) { return acc + e; }, 0.0f );
+        }, 0.0 },
+        { "AnyRange fold ", [&]() { return erased_fold( pipeline ); }, 0.0 },
+        { "AnyRange loop ", [&]() { return erased_loop( pipeline ); }, 0.0 },
+    };
+    bench( candidates, v.size() );
+
+    return 0;
+}
+
 #else
 
 template<class I>
@@ -143,6 +253,175 @@ int main( int, char *[] ) {
         .filter([] (auto e) { return e % 2 == 0; })
         .each([] (auto e) { std::cout << e << std::endl; });
 
+    example_header(6);
+
+    /*
+     * Prefix scans.
+     *
+     * `scan` lazily yields running accumulations, while `inclusiveScan` and
+     * `exclusiveScan` write them into a destination range - e.g. offsets of
+     * variable sized records from their counts. Run `make scan` to see the
+     * vectorized kernel picked for `std::plus<>` over contiguous memory.
+     */
+
+    iota( 1, 6 )
+        .scan( [](auto acc, auto e) { return acc * e; }, 1 ) // running factorial
+        .each( [](auto e) { std::cout << e << " "; } );
+    std::cout << std::endl;
+
+    std::vector<int> counts = { 3, 1, 4, 1, 5, 9, 2, 6 };
+    std::vector<int> offsets( counts.size() );
+
+    auto total = range( counts ).exclusiveScan( std::plus<>(), 0, offsets );
+
+    std::cout << range( offsets ) << "(total " << total << ")" << std::endl;
+
+    example_header(7);
+
+    /*
+     * Selection vectors.
+     *
+     * `select` evaluates the predicate over blocks without branching, and
+     * stores indices of passing elements. Selection can then gather elements
+     * of any range of the same length, e.g. other columns of a table.
+     */
+
+    std::vector<int> ids = { 10, 11, 12, 13, 14, 15 };
+    std::vector<float> prices = { 2.5f, 9.0f, 4.0f, 12.5f, 1.0f, 7.5f };
+
+    auto expensive = range( prices ).select( [](auto p) { return p > 4.0f; } );
+
+    std::cout << expensive.gather( range( ids ) ) << std::endl
+              << expensive.gather( range( prices ) ) << std::endl;
+
+    example_header(8);
+
+    /*
+     * Caching expensive mappings.
+     *
+     * Filter dereferences its source twice per passing element, so a mapping
+     * function before it would run twice. `cache` evaluates each element once.
+     * Given a capacity, random access ranges also keep values across traversals.
+     */
+
+    auto powers = iota( 10 )
+        .map( [](auto e) { return std::pow(e, 2.2f); } )
+        .cache( 10 );
+
+    powers
+        .filter( [](auto e) { return e > 10.0f; } )
+        .each( [](auto e) { std::cout << e << " "; } );
+    std::cout << std::endl;
+
+    std::cout << "sum: " << powers.fold( [](auto acc, auto e) { return acc + e; }, 0.0f ) << std::endl;
+
+    auto stats = cacheStats( powers );
+    std::cout << "evaluations: " << stats.evaluations << ", saved: " << stats.saved << std::endl;
+
+    example_header(9);
+
+    /*
+     * Type-erased ranges.
+     *
+     * AnyRange<T> holds any range of T-convertible values behind one type,
+     * so a pipeline can be passed to a function in another compilation unit.
+     * Elements are pulled in blocks, to keep virtual calls off the inner loop.
+     * Run `make anyrange-bench` to compare it with the templated pipeline.
+     */
+
+    AnyRange<float> erased = iota( 8 )
+        .map( [](auto e) { return e * 0.5f; } );
+
+    erased.each( [](auto e) { std::cout << e << " "; } );
+    std::cout << std::endl << "size: " << erased.size()
+              << ", sum: " << erased.fold( [](auto acc, auto e) { return acc + e; }, 0.0f ) << std::endl;
+
+    example_header(10);
+
+    /*
+     * Combining sorted ranges.
+     *
+     * `merge`, `setUnion`, `setIntersection` and `setDifference` lazily combine
+     * two sorted ranges, and `kwayMerge` any number of them.
+     */
+
+    std::vector<int> seen = { 1, 3, 4, 7, 9, 12 };
+    std::vector<int> paid = { 3, 5, 7, 12, 15 };
+
+    std::cout << "merge: " << range( seen ).merge( range( paid ) ) << std::endl
+              << "union: " << range( seen ).setUnion( range( paid ) ) << std::endl
+              << "intersection: " << range( seen ).setIntersection( range( paid ) ) << std::endl
+              << "difference: " << range( seen ).setDifference( range( paid ) ) << std::endl;
+
+    std::vector<int> shipped = { 2, 3, 8 };
+    std::cout << "k-way: " << kwayMerge( std::vector<decltype( range( seen ) )>{ range( seen ), range( paid ), range( shipped ) } )
+              << std::endl;
+
+    example_header(11);
+
+    /*
+     * Ownership.
+     *
+     * Ranges made from temporary containers own them, so they can't dangle.
+     * Each stage stores its function once, shared by all of its iterators,
+     * so big captures aren't copied around, and move-only callables work.
+     */
+
+    auto scale = std::make_unique<int>( 10 );
+
+    range( std::vector<int>{ 1, 2, 3 } )
+        .map( [scale = std::move( scale )](auto e) { return e * *scale; } )
+        .each( [](auto e) { std::cout << e << " "; } );
+    std::cout << std::endl;
+
+    example_header(12);
+
+    /*
+     * Flattening and joining.
+     *
+     * `flatten` turns a range of ranges (tiles, split parts) back into a range
+     * of elements, and `join` does the same with a separator in between.
+     * Terminal operations loop over each segment directly.
+     */
+
+    std::cout << iota( 12 ).tile( 3 ).flatten() << std::endl;
+
+    float step = 0.5f;
+    std::cout << iota( 12 )
+        .map( [step](auto e) { return e * step; } )
+        .tile( 4 )
+        .flatten() << std::endl;
+
+    std::vector<std::vector<int> > batches = {{1, 2}, {}, {3, 4, 5}};
+    std::cout << range( batches ).flatten() << std::endl;
+    std::cout << range( batches ).join( 0 ) << std::endl;
+
+    range( some_string )
+        .split( ' ' )
+        .join( '_' )
+        .each( [](auto c) { std::cout << c; } );
+    std::cout << std::endl;
+
+    example_header(13);
+
+    /*
+     * Incremental reduction.
+     *
+     * When only a few elements change between reductions, an incremental
+     * reducer keeps partial results in a segment tree, so that updates and
+     * sub-range reductions cost O(log n) instead of a new pass over the range.
+     */
+
+    std::vector<int> scores = {3, 9, 4, 7, 1, 8, 2, 6};
+    auto best = range( scores ).incremental( [](int a, int b) { return std::max( a, b ); } );
+
+    std::cout << best.reduce() << " " << best.take( 3 ).reduce() << " " << best.tail( 4 ).reduce() << std::endl;
+
+    best.update( 1, 0 ); // also writes to scores.
+    best.update( std::vector<size_t>{4, 6}, std::vector<int>{12, 5} );
+
+    std::cout << best.reduce() << " " << best.take( 3 ).reduce() << " " << best.drop( 5 ).reduce() << std::endl;
+
     return 0;
 }
 
@@ -2,9 +2,20 @@
 #define RANGE_HPP_
 
 #include <cstddef>
+#include <cstring>
 #include <iterator>
 #include <cassert>
 #include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <memory>
+#include <new>
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
 
 
 // Macro for iterator comparison operator implementation.
@@ -96,9 +107,58 @@
     }
 
 template<class I> struct GenericRange; // forward declaration used in iterators.
+class Selection;
+
+//! Evaluation counters of a caching range.
+struct CacheStats {
+    size_t evaluations = 0; // underlying element evaluations.
+    size_t saved = 0; // dereferences served from the cache.
+};
 
 namespace detail {
 
+//! Size up to which trivially copyable stage functions are held inline (two cache lines).
+constexpr size_t inline_stage_size = 128;
+
+/*
+ * State of a pipeline stage (function object), shared by all iterators of
+ * the stage. Small trivially copyable functions (function pointers, lambdas
+ * capturing by reference or capturing a few plain values) are held by
+ * value, so copies involve no reference counting and calls are easily
+ * inlined. Other callables - big captures, capturing containers,
+ * move-only - are stored once, on the heap.
+ */
+template<class Fn, class = void>
+struct Stage {
+    std::shared_ptr<Fn> fn;
+
+    explicit Stage( Fn fn ) : fn( std::make_shared<Fn>( std::move( fn ) ) ) {}
+
+    template<class... Args>
+    decltype( auto ) operator()( Args &&... args ) {
+        return ( *fn )( std::forward<Args>( args )... );
+    }
+};
+
+template<class Fn>
+struct Stage<Fn, std::enable_if_t<std::is_trivially_copyable<Fn>::value && sizeof( Fn ) <= inline_stage_size> > {
+    Fn fn;
+
+    explicit Stage( Fn fn ) : fn( fn ) {}
+    Stage( const Stage & ) = default;
+
+    // lambdas are not assignable, but trivially copyable ones can be copied bytewise.
+    Stage &operator=( const Stage &other ) {
+        std::memcpy( static_cast<void *>( &fn ), static_cast<const void *>( &other.fn ), sizeof( Fn ) );
+        return *this;
+    }
+
+    template<class... Args>
+    decltype( auto ) operator()( Args &&... args ) {
+        return fn( std::forward<Args>( args )... );
+    }
+};
+
 /*
  * Iterator implementation details used to construct range utilities in this module.
  */
@@ -114,9 +174,9 @@ struct MapIterator :
     using reference = value_type;
 
     I iter;
-    Fn fn;
+    Stage<Fn> fn;
 
-    MapIterator( I iter, Fn fn ) : iter( iter ), fn( fn ) {}
+    MapIterator( I iter, Stage<Fn> fn ) : iter( iter ), fn( fn ) {}
 
     value_type operator*() {
         return fn( *iter );
@@ -226,9 +286,9 @@ struct FilterIterator :
 
     I iter;
     I end;
-    Fn fn;
+    Stage<Fn> fn;
 
-    FilterIterator( I iter, I end, Fn fn ) : iter( iter ), end( end ), fn( fn ) {}
+    FilterIterator( I iter, I end, Stage<Fn> fn ) : iter( iter ), end( end ), fn( fn ) {}
 
     auto operator*() {
         while( iter != end && !fn( *iter ) ) {
@@ -262,6 +322,7 @@ struct IotaIterator :
     I iter;
     J jump;
 
+    IotaIterator() : iter(), jump() {}
     IotaIterator( I iter, J jump ) : iter( iter ), jump( jump ) {}
 
     auto operator*() {
@@ -301,202 +362,1544 @@ struct IotaIterator :
     ITERATOR_WRAPPER_COMPARISON_IMPL( IotaIterator, iter )
 };
 
+template<class I, class Fn>
+struct ScanIterator :
+    public std::iterator<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<I>::value_type,
+    ptrdiff_t,
+    typename std::iterator_traits<I>::value_type,
+    typename std::iterator_traits<I>::value_type >  {
 
-template<class T, class O>
-T cast( O o ) {
-    return static_cast<T>( o );
-}
+    using value_type = typename std::iterator_traits<I>::value_type;
 
-} // end of detail
+    I iter;
+    I end;
+    Stage<Fn> fn;
+    value_type acc; // running prefix, including the element at iter.
+
+    ScanIterator( I iter, I end, Stage<Fn> fn, value_type init ) : iter( iter ), end( end ), fn( fn ), acc( init ) {
+        if ( iter != end )
+            acc = fn( acc, *iter );
+    }
+
+    value_type operator*() {
+        return acc;
+    }
+
+    ScanIterator &operator++() {
+        if ( ++iter != end )
+            acc = fn( acc, *iter );
+        return *this;
+    }
+
+    ScanIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+
+    ITERATOR_WRAPPER_COMPARISON_IMPL( ScanIterator, iter )
+};
 
-/**
- * Generic range utility type.
- *
- * Represents a thin wrapper over generic iterator range, which is
- * defined with `begin` and `end`.
- */
 template<class I>
-struct GenericRange {
+struct GatherIterator :
+    public std::iterator<
+    std::random_access_iterator_tag,
+    typename std::iterator_traits<I>::value_type >  {
 
-public:
-    using iterator = I;
-    using value_type = typename std::iterator_traits<I>::value_type;
-    using pointer = typename std::iterator_traits<I>::pointer;
-    using referece = typename std::iterator_traits<I>::reference;
+    const size_t *iter; // position in the selection vector.
+    I base; // beginning of the gathered range.
 
-private:
-    I _b, // beginning iterator of the range.
-    _e; // ending iterator of the range.
+    GatherIterator( const size_t *iter, I base ) : iter( iter ), base( base ) {}
 
-public:
-    GenericRange() = delete; // void range is invalid.
+    decltype( auto ) operator*() {
+        return *( base + *iter );
+    }
 
-    //! Range constructor.
-    GenericRange( I b, I e ) : _b( b ), _e( e ) {}
+    RANDOM_ACCESS_ITERATOR_WRAPPER_IMPL( GatherIterator, base )
+};
 
-    //! Beginning of the range.
-    auto begin() {
-        return _b;
+template<class T>
+struct CacheState {
+    std::vector<T> buffer; // materialized values of the first buffer.size() positions.
+    std::vector<unsigned char> valid;
+    CacheStats stats;
+
+    CacheState( size_t capacity ) : buffer( capacity ), valid( capacity, 0 ) {}
+};
+
+template<class I>
+struct CachingIterator :
+    public std::iterator<
+    typename std::iterator_traits<I>::iterator_category,
+    typename std::iterator_traits<I>::value_type >  {
+
+    using value_type = typename std::iterator_traits<I>::value_type;
+    using pointer = value_type;
+    using reference = value_type;
+
+    I iter;
+    I origin; // beginning of the cached range, to index the buffer.
+    std::shared_ptr<CacheState<value_type> > state;
+    value_type value; // value at iter, valid if cached is set.
+    bool cached;
+
+    CachingIterator( I iter, I origin, std::shared_ptr<CacheState<value_type> > state ) :
+        iter( iter ), origin( origin ), state( state ), value(), cached( false ) {}
+
+    value_type operator*() {
+        if ( cached ) {
+            ++state->stats.saved;
+        } else {
+            value = fetch( typename std::iterator_traits<I>::iterator_category() );
+            cached = true;
+        }
+        return value;
     }
 
-    //! Ending of the range.
-    auto end() {
-        return _e;
+    const CacheStats &stats() const {
+        return state->stats;
     }
 
-    //! Length of the range.
-    auto size() const {
-        return std::distance( _b, _e );
+    CachingIterator &operator++() {
+        ++iter;
+        cached = false;
+        return *this;
+    }
+    CachingIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+    CachingIterator &operator--() {
+        --iter;
+        cached = false;
+        return *this;
+    }
+    CachingIterator operator--( int ) {
+        auto t( *this );
+        operator--();
+        return t;
+    }
+    CachingIterator operator+( size_t c ) {
+        return CachingIterator( iter + c, origin, state );
+    }
+    CachingIterator operator-( size_t c ) {
+        return CachingIterator( iter - c, origin, state );
+    }
+    ptrdiff_t operator-( const CachingIterator &other ) const {
+        return std::distance( other.iter, iter );
     }
 
-    // Range utility wrappers.
+    ITERATOR_WRAPPER_COMPARISON_IMPL( CachingIterator, iter )
 
-    template<class Fn> void each( Fn fn );
-    template<class Fn> GenericRange<detail::MapIterator<I, Fn> > map( Fn fn );
-    template<class T> GenericRange<detail::MapIterator<I, T( * )( value_type ) > > as();
-    template<class Fn> GenericRange<detail::FilterIterator<I, Fn> > filter( Fn fn );
-    template<class Fn> value_type reduce( Fn fn );
-    template<class Fn> value_type fold( Fn fn, value_type init );
-    GenericRange<I> take( size_t n );
-    GenericRange<I> drop( size_t n = 1 );
-    GenericRange<I> tail( size_t n );
-    template<class O> void copyTo( GenericRange<O> other ) const;
-    template<class Range> void copyTo( Range &other ) const;
-    auto tile( size_t tile_length );
-    GenericRange<detail::SplitIterator<I> > split( value_type delimiter );
+private:
+    value_type fetch( std::input_iterator_tag ) {
+        ++state->stats.evaluations;
+        return *iter;
+    }
+
+    value_type fetch( std::random_access_iterator_tag ) {
+        auto i = static_cast<size_t>( std::distance( origin, iter ) );
+        if ( i >= state->buffer.size() )
+            return fetch( std::input_iterator_tag() );
+        if ( state->valid[i] ) {
+            ++state->stats.saved;
+        } else {
+            state->buffer[i] = fetch( std::input_iterator_tag() );
+            state->valid[i] = 1;
+        }
+        return state->buffer[i];
+    }
 };
 
-template<class T>
-struct is_generic_range : std::false_type {};
+/*
+ * Local range of a flattening iterator. Storage stays uninitialized until
+ * the first segment is loaded, and segments are copy constructed in place,
+ * so local iterators need to be neither default constructible nor
+ * assignable (e.g. map over a lambda).
+ */
+template<class L, bool = std::is_default_constructible<L>::value>
+class LocalRange {
+    struct Bounds {
+        L b, e;
+    };
+    union {
+        Bounds bounds;
+    };
+    bool loaded;
 
-template<class I>
-struct is_generic_range<GenericRange<I> > : std::true_type {};
+public:
+    LocalRange() : loaded( false ) {}
 
-//! Generic range wrapper constructor.
-template<class I>
-auto range( I begin, I end ) {
-    return GenericRange<I>( begin, end );
-}
+    LocalRange( const LocalRange &other ) : loaded( false ) {
+        if ( other.loaded )
+            load( other.bounds.b, other.bounds.e );
+    }
 
-//! Generic range wrapper constructor.
-template<class Range>
-auto range( Range &r ) {
-    return GenericRange<typename Range::iterator>( r.begin(), r.end() );
-}
+    LocalRange &operator=( const LocalRange &other ) {
+        if ( this != &other ) {
+            reset();
+            if ( other.loaded )
+                load( other.bounds.b, other.bounds.e );
+        }
+        return *this;
+    }
 
-//! Generic range wrapper constructor.
-template<class Range>
-auto range( const Range &r ) {
-    return GenericRange<typename Range::const_iterator>( r.begin(), r.end() );
-}
+    ~LocalRange() {
+        reset();
+    }
 
-/**
- * @brief Tile the range to sub-ranges of given lenght.
- *
- * @param range Range to be tiled.
- * @param tile_size Size of tile.
- *
- * @return Range of tiles.
- */
-template<class Range>
-auto tile( Range range, size_t tile_size ) {
-    int el = static_cast<int>( range.size() );
-    el -= el % tile_size;
+    void load( L b, L e ) {
+        reset();
+        new ( &bounds ) Bounds{ b, e };
+        loaded = true;
+    }
 
-    assert( el > 0 );
+    void reset() {
+        if ( loaded ) {
+            bounds.~Bounds();
+            loaded = false;
+        }
+    }
 
-    using I = detail::TilingIterator<typename Range::iterator>;
+    L &begin() {
+        return bounds.b;
+    }
+    const L &begin() const {
+        return bounds.b;
+    }
+    const L &end() const {
+        return bounds.e;
+    }
+};
 
-    return GenericRange<I>(
-               I( range.begin(), range.begin() + tile_size ),
-               I( range.begin() + el, range.end() )
-           );
-}
+//! Default constructible local iterators are held directly.
+template<class L>
+class LocalRange<L, true> {
+    L b, e;
 
-/**
- * @brief Split a range by given delimiter.
- *
- * @param range Range to be split.
- * @param delimiter Delimiter value by which to split the range.
- *
- * @return Range of sub-ranges split by given delimiter.
- */
-template<class Range>
-auto split( Range range, typename Range::value_type delimiter ) {
-    using I = typename Range::iterator;
-    return GenericRange<detail::SplitIterator<I> >(
-               detail::SplitIterator<I>( range.begin(), range.end(), delimiter ),
-               detail::SplitIterator<I>( range.end(), range.end(), delimiter )
-           );
-}
+public:
+    LocalRange() : b(), e() {}
 
-/**
- * @brief Range (sequence) of integral values.
- *
- * @param start Start of the sequence.
- * @param end End of sequence.
- * @param jump Stride value from one to the next value in sequence.
- *
- * @return Lazy range (sequence) of values.
- */
-template<class I, class J = I>
-auto iota( I start, I end, J jump = J( 1 ) ) {
-    static_assert(std::is_integral<I>::value && std::is_integral<J>::value, 
-            "Value types have to be integral.");
-    return GenericRange<detail::IotaIterator<I, J> >(
-               detail::IotaIterator<I, J>( start, jump ),
-               detail::IotaIterator<I, J>( end, jump )
-           );
-}
+    void load( L b, L e ) {
+        this->b = b;
+        this->e = e;
+    }
 
-//! Integral sequence from 0 to given number, by jump of 1.
-template<class I>
-auto iota( I count ) {
-    return ::iota(0, count, 1);
-}
+    L &begin() {
+        return b;
+    }
+    const L &begin() const {
+        return b;
+    }
+    const L &end() const {
+        return e;
+    }
+};
 
-/**
- * @brief Apply function mapping to the data range.
- *
- * Create lazy mapping range. Function is applied to
- * range elements lazily as they are accesed, generating
- * a resulting range.
+/*
+ * Flattening iterator over a range of ranges (e.g. tiles, or split parts),
+ * optionally yielding a separator between segments (join).
  *
- * @param fn Function.
- * @param range Data range.
+ * It is a segmented iterator: besides the element by element protocol, it
+ * exposes its outer position and the remaining local range of the current
+ * segment, so terminal operations (see forEachSegmented) can run a plain loop over
+ * each segment, without checking for the segment end on every element.
+ * The local range is loaded whenever outer is not at its end.
  *
- * @param Lazy mapping range.
+ * Local iterators point into the segments, so segments have to be
+ * referenced by the outer iterator (e.g. containers in a container), or be
+ * views (e.g. tiles) - not temporaries owning their elements.
  */
-template<class Range, class Fn>
-auto map( Fn fn, Range range ) {
-    using I = typename Range::iterator;
-    using Mi = detail::MapIterator<I, Fn>;
+template<class R>
+struct is_segment_reference : std::is_lvalue_reference<R> {};
 
-    return GenericRange<Mi>(
-               Mi( range.begin(), fn ),
-               Mi( range.end(), fn )
-           );
-}
+template<class I>
+struct is_segment_reference<GenericRange<I> > : std::true_type {};
 
-/**
- * @brief Apply data reduction with given function.
- *
- * @param fn Reduction function.
- * @param range Range to reduce.
- *
- * @return Reduction value.
- */
-template<class Fn, class Range>
-auto reduce( Fn fn, Range range ) {
-    assert(range.size() > 0);
-    auto r = ::range( range );
-    typename Range::value_type acc = *r.begin();
-    for ( auto const &i : range.drop() ) {
-        acc = fn( acc, i );
+template<class O>
+struct FlattenIterator :
+    public std::iterator<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<O>::value_type::value_type,
+    ptrdiff_t,
+    typename std::iterator_traits<O>::value_type::value_type,
+    typename std::iterator_traits<O>::value_type::value_type >  {
+
+    using segment_reference = decltype( *std::declval<O &>() );
+    using local_iterator = decltype( std::declval<segment_reference>().begin() );
+    using value_type = typename std::iterator_traits<O>::value_type::value_type;
+
+    static_assert( is_segment_reference<segment_reference>::value,
+                   "Flattened segments have to be referenced, or be views, not temporaries owning their elements." );
+
+    O outer, outer_end;
+    LocalRange<local_iterator> local;
+    bool joined; // yield separator between segments.
+    bool at_separator;
+    value_type separator;
+
+    FlattenIterator( O outer, O outer_end, bool joined, value_type separator ) :
+        outer( outer ), outer_end( outer_end ), local(),
+        joined( joined ), at_separator( false ), separator( separator ) {
+        if ( outer != outer_end ) {
+            load();
+            normalize();
+        }
+    }
+
+    value_type operator*() {
+        return at_separator ? separator : *local.begin();
+    }
+
+    FlattenIterator &operator++() {
+        if ( at_separator ) {
+            at_separator = false;
+            ++outer;
+            load();
+        } else {
+            ++local.begin();
+        }
+        normalize();
+        return *this;
+    }
+
+    FlattenIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+
+    bool operator==( const FlattenIterator &other ) const {
+        return outer == other.outer &&
+               ( outer == outer_end || ( local.begin() == other.local.begin() && at_separator == other.at_separator ) );
+    }
+    bool operator!=( const FlattenIterator &other ) const {
+        return !operator==( other );
+    }
+
+    //! Remaining local range of the current segment. Empty at a separator.
+    GenericRange<local_iterator> segment() const {
+        return GenericRange<local_iterator>( at_separator ? local.end() : local.begin(), local.end() );
+    }
+
+    //! Skip the rest of the current segment (or the separator).
+    void nextSegment() {
+        if ( at_separator ) {
+            operator++();
+        } else {
+            local.load( local.end(), local.end() );
+            normalize();
+        }
+    }
+
+private:
+    void load() {
+        auto &&s = *outer; // views are copied, containers referenced.
+        local.load( s.begin(), s.end() );
+    }
+
+    // move past exhausted segments, stopping at separators between them when joining.
+    void normalize() {
+        while ( outer != outer_end && !at_separator && local.begin() == local.end() ) {
+            if ( joined ) {
+                auto next = outer;
+                if ( ++next == outer_end )
+                    outer = outer_end;
+                else
+                    at_separator = true;
+                return;
+            }
+            if ( ++outer != outer_end )
+                load();
+        }
+    }
+};
+
+//! Segmented traversal: a plain loop per segment, without per element segment end checks.
+template<class O, class Fn>
+void forEachSegmented( FlattenIterator<O> b, FlattenIterator<O> e, Fn &&fn ) {
+    if ( e.outer != e.outer_end ) {
+        // ends in the middle of a segment.
+        for ( ; b != e; ++b ) {
+            fn( *b );
+        }
+        return;
+    }
+
+    while ( b.outer != b.outer_end ) {
+        if ( b.at_separator ) {
+            fn( b.separator );
+        } else {
+            for ( auto l = b.local.begin(), le = b.local.end(); l != le; ++l ) {
+                fn( *l );
+            }
+        }
+        b.nextSegment();
+    }
+}
+
+/*
+ * Loops of terminal operations. Plain loops for ordinary iterators, kept
+ * as simple as possible so they vectorize; segment by segment loops for
+ * segmented iterators.
+ */
+
+template<class I, class Fn>
+void eachRange( I b, I e, Fn &fn ) {
+    for ( ; b != e; ++b ) {
+        auto v = *b; // generic ranges pass elements by copy.
+        fn( v );
+    }
+}
+
+template<class O, class Fn>
+void eachRange( FlattenIterator<O> b, FlattenIterator<O> e, Fn &fn ) {
+    forEachSegmented( b, e, [&fn]( auto v ) {
+        fn( v );
+    } );
+}
+
+template<class I, class T, class Fn>
+T foldRange( I b, I e, T acc, Fn &fn ) {
+    for ( ; b != e; ++b ) {
+        acc = fn( acc, *b );
+    }
+    return acc;
+}
+
+template<class O, class T, class Fn>
+T foldRange( FlattenIterator<O> b, FlattenIterator<O> e, T acc, Fn &fn ) {
+    forEachSegmented( b, e, [&]( auto const &i ) {
+        acc = fn( acc, i );
+    } );
+    return acc;
+}
+
+// Copies of trivially copy constructible iterators are free, and post-incrementing
+// them keeps calls through function pointer stages inlined (so the loop
+// vectorizes) with gcc.
+template<class I, class O>
+void copyElements( I b, I e, O o, std::true_type ) {
+    while( b != e ) {
+        *o = *( b++ );
+        ++o;
+    }
+}
+
+// Other iterators (owned containers, heap stages) are only pre-incremented,
+// so that shared state is not reference counted per element.
+template<class I, class O>
+void copyElements( I b, I e, O o, std::false_type ) {
+    for ( ; b != e; ++b, ++o ) {
+        *o = *b;
+    }
+}
+
+template<class I, class O>
+void copyRange( I b, I e, O o ) {
+    copyElements( b, e, o, std::integral_constant<bool,
+                  std::is_trivially_copy_constructible<I>::value && std::is_trivially_destructible<I>::value>() );
+}
+
+template<class F, class O>
+void copyRange( FlattenIterator<F> b, FlattenIterator<F> e, O o ) {
+    forEachSegmented( b, e, [&o]( auto const &v ) {
+        *o = v;
+        ++o;
+    } );
+}
+
+/*
+ * Iterator of a range owning its container, adopted from a temporary.
+ * All iterators of the range share the ownership.
+ */
+template<class C>
+struct OwningIterator :
+    public std::iterator<
+    typename std::iterator_traits<typename C::iterator>::iterator_category,
+    typename std::iterator_traits<typename C::iterator>::value_type,
+    typename std::iterator_traits<typename C::iterator>::difference_type,
+    typename std::iterator_traits<typename C::iterator>::pointer,
+    typename std::iterator_traits<typename C::iterator>::reference >  {
+
+    typename C::iterator iter;
+    std::shared_ptr<C> owner;
+
+    OwningIterator( typename C::iterator iter, std::shared_ptr<C> owner ) : iter( iter ), owner( owner ) {}
+
+    decltype( auto ) operator*() {
+        return *iter;
+    }
+
+    RANDOM_ACCESS_ITERATOR_WRAPPER_IMPL( OwningIterator, owner )
+};
+
+/*
+ * Sorted range combination. All iterators below expect their inputs to be
+ * sorted by the given comparison.
+ */
+
+//! Size ratio of random access inputs from which set operations gallop.
+constexpr size_t gallop_ratio = 8;
+
+//! Exponential search for the first element in [first, last) not less than value.
+template<class I, class T, class Cmp>
+I gallop( I first, I last, const T &value, Cmp &cmp ) {
+    auto n = static_cast<size_t>( std::distance( first, last ) );
+    size_t lo = 0, hi = 1;
+
+    while ( hi < n && cmp( *( first + hi ), value ) ) {
+        lo = hi;
+        hi *= 2;
+    }
+    hi = std::min( hi, n );
+
+    while ( lo < hi ) {
+        auto mid = lo + ( hi - lo ) / 2;
+        if ( cmp( *( first + mid ), value ) )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return first + lo;
+}
+
+//! Skip elements less than value, galloping if enabled and possible.
+template<class I, class T, class Cmp>
+I skipLess( I first, I last, const T &value, Cmp &cmp, bool, std::input_iterator_tag ) {
+    while ( first != last && cmp( *first, value ) ) {
+        ++first;
+    }
+    return first;
+}
+
+template<class I, class T, class Cmp>
+I skipLess( I first, I last, const T &value, Cmp &cmp, bool galloping, std::random_access_iterator_tag ) {
+    if ( galloping )
+        return gallop( first, last, value, cmp );
+    return skipLess( first, last, value, cmp, false, std::input_iterator_tag() );
+}
+
+template<class I, class T, class Cmp>
+I skipLess( I first, I last, const T &value, Cmp &cmp, bool galloping ) {
+    return skipLess( first, last, value, cmp, galloping, typename std::iterator_traits<I>::iterator_category() );
+}
+
+//! Should set operations over given ranges gallop, i.e. are their sizes far apart.
+template<class R1, class R2>
+bool shouldGallop( R1 &, R2 &, std::false_type ) {
+    return false;
+}
+
+template<class R1, class R2>
+bool shouldGallop( R1 &a, R2 &b, std::true_type ) {
+    auto na = static_cast<size_t>( a.size() ), nb = static_cast<size_t>( b.size() );
+    return std::max( na, nb ) >= gallop_ratio * std::max<size_t>( std::min( na, nb ), 1 );
+}
+
+template<class R1, class R2>
+bool shouldGallop( R1 &a, R2 &b ) {
+    using C1 = typename std::iterator_traits<typename R1::iterator>::iterator_category;
+    using C2 = typename std::iterator_traits<typename R2::iterator>::iterator_category;
+    return shouldGallop( a, b, std::integral_constant<bool,
+                         std::is_base_of<std::random_access_iterator_tag, C1>::value &&
+                         std::is_base_of<std::random_access_iterator_tag, C2>::value>() );
+}
+
+/*
+ * Merge of two sorted ranges. With Unique set, equivalent elements present
+ * in both ranges are yielded once (set union), otherwise all elements are
+ * yielded, and ties are taken from the first range first.
+ */
+template<class I1, class I2, class Cmp, bool Unique>
+struct MergeIterator :
+    public std::iterator<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<I1>::value_type,
+    ptrdiff_t,
+    typename std::iterator_traits<I1>::value_type,
+    typename std::iterator_traits<I1>::value_type >  {
+
+    using value_type = typename std::iterator_traits<I1>::value_type;
+
+    I1 a, ae;
+    I2 b, be;
+    Stage<Cmp> cmp;
+
+    MergeIterator( I1 a, I1 ae, I2 b, I2 be, Stage<Cmp> cmp ) : a( a ), ae( ae ), b( b ), be( be ), cmp( cmp ) {}
+
+    value_type operator*() {
+        if ( a == ae || ( b != be && cmp( *b, *a ) ) )
+            return *b;
+        return *a;
+    }
+
+    MergeIterator &operator++() {
+        if ( a == ae || ( b != be && cmp( *b, *a ) ) ) {
+            ++b;
+        } else {
+            // element of the first range was yielded, skip its match in the second for unions.
+            if ( Unique && b != be && !cmp( *a, *b ) )
+                ++b;
+            ++a;
+        }
+        return *this;
+    }
+
+    MergeIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+
+    bool operator==( const MergeIterator &other ) const {
+        return a == other.a && b == other.b;
+    }
+    bool operator!=( const MergeIterator &other ) const {
+        return !operator==( other );
+    }
+};
+
+template<class I1, class I2, class Cmp>
+struct IntersectionIterator :
+    public std::iterator<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<I1>::value_type,
+    ptrdiff_t,
+    typename std::iterator_traits<I1>::value_type,
+    typename std::iterator_traits<I1>::value_type >  {
+
+    using value_type = typename std::iterator_traits<I1>::value_type;
+
+    I1 a, ae;
+    I2 b, be;
+    Stage<Cmp> cmp;
+    bool galloping;
+
+    IntersectionIterator( I1 a, I1 ae, I2 b, I2 be, Stage<Cmp> cmp, bool galloping ) :
+        a( a ), ae( ae ), b( b ), be( be ), cmp( cmp ), galloping( galloping ) {
+        settle();
+    }
+
+    value_type operator*() {
+        return *a;
+    }
+
+    IntersectionIterator &operator++() {
+        ++a;
+        ++b;
+        settle();
+        return *this;
+    }
+
+    IntersectionIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+
+    ITERATOR_WRAPPER_COMPARISON_IMPL( IntersectionIterator, a )
+
+private:
+    // advance both sides to the next common element, or to the end.
+    void settle() {
+        while ( a != ae && b != be ) {
+            if ( cmp( *a, *b ) )
+                a = skipLess( a, ae, *b, cmp, galloping );
+            else if ( cmp( *b, *a ) )
+                b = skipLess( b, be, *a, cmp, galloping );
+            else
+                return;
+        }
+        a = ae;
+        b = be;
+    }
+};
+
+template<class I1, class I2, class Cmp>
+struct DifferenceIterator :
+    public std::iterator<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<I1>::value_type,
+    ptrdiff_t,
+    typename std::iterator_traits<I1>::value_type,
+    typename std::iterator_traits<I1>::value_type >  {
+
+    using value_type = typename std::iterator_traits<I1>::value_type;
+
+    I1 a, ae;
+    I2 b, be;
+    Stage<Cmp> cmp;
+    bool galloping;
+
+    DifferenceIterator( I1 a, I1 ae, I2 b, I2 be, Stage<Cmp> cmp, bool galloping ) :
+        a( a ), ae( ae ), b( b ), be( be ), cmp( cmp ), galloping( galloping ) {
+        settle();
+    }
+
+    value_type operator*() {
+        return *a;
+    }
+
+    DifferenceIterator &operator++() {
+        ++a;
+        settle();
+        return *this;
+    }
+
+    DifferenceIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+
+    ITERATOR_WRAPPER_COMPARISON_IMPL( DifferenceIterator, a )
+
+private:
+    // advance to the next element of the first range not matched in the second one.
+    void settle() {
+        while ( a != ae && b != be ) {
+            if ( cmp( *a, *b ) )
+                return;
+            if ( cmp( *b, *a ) ) {
+                b = skipLess( b, be, *a, cmp, galloping );
+            } else {
+                ++a;
+                ++b;
+            }
+        }
+    }
+};
+
+/*
+ * K-way merge over a tournament (loser) tree.
+ *
+ * tree[0] holds the index of the source with the smallest current element,
+ * and tree[1..k) the losers of matches along the way, so advancing the
+ * winner replays only its path to the root - log2(k) comparisons.
+ *
+ * The O(k) state is shared between copies of an iterator, and copied only
+ * when a shared one is advanced, so iterator copies are O(1).
+ */
+template<class I>
+struct KWayState {
+    std::vector<I> cur, end;
+    std::vector<size_t> tree;
+};
+
+template<class I, class Cmp>
+struct KWayMergeIterator :
+    public std::iterator<
+    std::forward_iterator_tag,
+    typename std::iterator_traits<I>::value_type,
+    ptrdiff_t,
+    typename std::iterator_traits<I>::value_type,
+    typename std::iterator_traits<I>::value_type >  {
+
+    using value_type = typename std::iterator_traits<I>::value_type;
+
+    std::shared_ptr<KWayState<I> > state;
+    Stage<Cmp> cmp;
+    size_t remaining;
+
+    KWayMergeIterator( std::vector<GenericRange<I> > &ranges, Stage<Cmp> cmp ) :
+        state( std::make_shared<KWayState<I> >() ), cmp( cmp ), remaining( 0 ) {
+        auto k = ranges.size();
+        auto &s = *state;
+        s.cur.reserve( k );
+        s.end.reserve( k );
+        for ( auto &r : ranges ) {
+            s.cur.push_back( r.begin() );
+            s.end.push_back( r.end() );
+            remaining += static_cast<size_t>( r.size() );
+        }
+
+        // k stands for a virtual source smaller than any other, until all sources are placed.
+        s.tree.assign( k, k );
+        for ( auto i = k; i-- > 0; ) {
+            adjust( s, i );
+        }
+    }
+
+    explicit KWayMergeIterator( Stage<Cmp> cmp ) : cmp( cmp ), remaining( 0 ) {}
+
+    value_type operator*() {
+        return *state->cur[state->tree[0]];
+    }
+
+    KWayMergeIterator &operator++() {
+        if ( state.use_count() > 1 )
+            state = std::make_shared<KWayState<I> >( *state );
+        auto &s = *state;
+        auto w = s.tree[0];
+        ++s.cur[w];
+        --remaining;
+        adjust( s, w );
+        return *this;
+    }
+
+    KWayMergeIterator operator++( int ) {
+        auto t( *this );
+        operator++();
+        return t;
+    }
+
+    ITERATOR_WRAPPER_COMPARISON_IMPL( KWayMergeIterator, remaining )
+
+private:
+    // should source x be yielded before source y. Ties go to the lower index.
+    bool beats( KWayState<I> &s, size_t x, size_t y ) {
+        auto k = s.cur.size();
+        if ( x == k || y == k )
+            return x == k;
+        if ( s.cur[x] == s.end[x] || s.cur[y] == s.end[y] )
+            return s.cur[y] == s.end[y] && s.cur[x] != s.end[x];
+        // ties resolved by index, so one comparison per match.
+        return x < y ? !cmp( *s.cur[y], *s.cur[x] ) : cmp( *s.cur[x], *s.cur[y] );
+    }
+
+    // replay matches of source i from its leaf to the root.
+    void adjust( KWayState<I> &s, size_t i ) {
+        for ( auto t = ( i + s.cur.size() ) / 2; t > 0; t /= 2 ) {
+            if ( beats( s, s.tree[t], i ) )
+                std::swap( i, s.tree[t] );
+        }
+        s.tree[0] = i;
+    }
+};
+
+//! Number of elements pulled through a type-erased range per indirect call.
+constexpr size_t any_range_block = 64;
+
+/*
+ * Type-erased source of an AnyRange. Each source keeps its own traversal
+ * position, and hands out elements in blocks.
+ */
+template<class T>
+struct AnySource {
+    virtual ~AnySource() {}
+
+    //! Copy up to n next elements to block, return number of copied elements.
+    virtual size_t fill( T *block, size_t n ) = 0;
+
+    //! Length of the whole source range.
+    virtual size_t size() const = 0;
+
+    //! Rewound copy, placed in storage if it fits in capacity bytes, on heap otherwise.
+    virtual AnySource *clone( void *storage, size_t capacity ) const = 0;
+
+    //! Copy at the current traversal position, placed as with clone.
+    virtual AnySource *fork( void *storage, size_t capacity ) const = 0;
+};
+
+//! Tag of a source copy keeping the traversal position.
+struct KeepPosition {};
+
+template<class T, class Range>
+struct AnySourceImpl : public AnySource<T> {
+    Range range;
+    typename Range::iterator cur;
+
+    AnySourceImpl( Range range ) : range( range ), cur( this->range.begin() ) {}
+    AnySourceImpl( const AnySourceImpl &other ) : range( other.range ), cur( range.begin() ) {}
+    // range is a view, so its iterators stay valid in copies.
+    AnySourceImpl( const AnySourceImpl &other, KeepPosition ) : range( other.range ), cur( other.cur ) {}
+
+    template<class... Args>
+    static AnySource<T> *emplace( void *storage, size_t capacity, Args &&... args ) {
+        if ( sizeof( AnySourceImpl ) <= capacity && alignof( AnySourceImpl ) <= alignof( std::max_align_t ) )
+            return new ( storage ) AnySourceImpl( std::forward<Args>( args )... );
+        return new AnySourceImpl( std::forward<Args>( args )... );
+    }
+
+    size_t fill( T *block, size_t n ) override {
+        return fill( block, n, typename std::iterator_traits<typename Range::iterator>::iterator_category() );
+    }
+
+    size_t size() const override {
+        return static_cast<size_t>( range.size() );
+    }
+
+    AnySource<T> *clone( void *storage, size_t capacity ) const override {
+        return emplace( storage, capacity, *this );
+    }
+
+    AnySource<T> *fork( void *storage, size_t capacity ) const override {
+        return emplace( storage, capacity, *this, KeepPosition() );
+    }
+
+private:
+    size_t fill( T *block, size_t n, std::input_iterator_tag ) {
+        auto end = range.end();
+        size_t i = 0;
+        for ( ; i < n && cur != end; ++i, ++cur ) {
+            block[i] = *cur;
+        }
+        return i;
+    }
+
+    size_t fill( T *block, size_t n, std::random_access_iterator_tag ) {
+        // count known up front, so that the copy loop has no end check.
+        n = std::min( n, static_cast<size_t>( std::distance( cur, range.end() ) ) );
+        for ( size_t i = 0; i < n; ++i, ++cur ) {
+            block[i] = *cur;
+        }
+        return n;
+    }
+};
+
+//! Number of elements per predicate evaluation block of a Selection.
+constexpr size_t selection_block = 1024;
+
+
+template<class T, class O>
+T cast( O o ) {
+    return static_cast<T>( o );
+}
+
+/*
+ * Scan (prefix reduction) kernels used by inclusiveScan and exclusiveScan.
+ */
+
+//! Iterators known to address contiguous memory, i.e. `&*it + n == &*(it + n)`.
+template<class I, class T = typename std::iterator_traits<I>::value_type>
+struct is_contiguous_iterator : std::integral_constant<bool,
+    std::is_pointer<I>::value ||
+    ( !std::is_same<T, bool>::value &&
+      ( std::is_same<I, typename std::vector<T>::iterator>::value ||
+        std::is_same<I, typename std::vector<T>::const_iterator>::value ) ) > {};
+
+template<class C, class T>
+struct is_contiguous_iterator<OwningIterator<C>, T> : is_contiguous_iterator<typename C::iterator> {};
+
+template<class T, class Fn>
+struct is_plus : std::false_type {};
+
+template<class T>
+struct is_plus<T, std::plus<T> > : std::true_type {};
+
+template<class T>
+struct is_plus<T, std::plus<> > : std::true_type {};
+
+template<class T, class = void>
+struct SimdScan {
+    static constexpr bool enabled = false;
+};
+
+#if defined( __SSE2__ )
+
+/*
+ * In-register prefix sums over 128 bit vectors. `scan` performs log2(lanes)
+ * shift-and-add steps, `broadcastLast` spreads the block total to all lanes
+ * to be carried into the next block.
+ */
+
+template<class T>
+struct SimdScan<T, std::enable_if_t<std::is_integral<T>::value && sizeof( T ) == 4> > {
+    static constexpr bool enabled = true;
+    static constexpr size_t lanes = 4;
+    using reg = __m128i;
+
+    static reg load( const T *p ) { return _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) ); }
+    static void store( T *p, reg r ) { _mm_storeu_si128( reinterpret_cast<__m128i *>( p ), r ); }
+    static reg set1( T v ) { return _mm_set1_epi32( static_cast<int>( v ) ); }
+    static reg add( reg a, reg b ) { return _mm_add_epi32( a, b ); }
+    static reg shiftLane( reg x ) { return _mm_slli_si128( x, 4 ); }
+    static reg broadcastLast( reg x ) { return _mm_shuffle_epi32( x, _MM_SHUFFLE( 3, 3, 3, 3 ) ); }
+    static reg scan( reg x ) {
+        x = add( x, _mm_slli_si128( x, 4 ) );
+        return add( x, _mm_slli_si128( x, 8 ) );
+    }
+};
+
+template<class T>
+struct SimdScan<T, std::enable_if_t<std::is_integral<T>::value && sizeof( T ) == 8> > {
+    static constexpr bool enabled = true;
+    static constexpr size_t lanes = 2;
+    using reg = __m128i;
+
+    static reg load( const T *p ) { return _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) ); }
+    static void store( T *p, reg r ) { _mm_storeu_si128( reinterpret_cast<__m128i *>( p ), r ); }
+    static reg set1( T v ) { return _mm_set1_epi64x( static_cast<long long>( v ) ); }
+    static reg add( reg a, reg b ) { return _mm_add_epi64( a, b ); }
+    static reg shiftLane( reg x ) { return _mm_slli_si128( x, 8 ); }
+    static reg broadcastLast( reg x ) { return _mm_shuffle_epi32( x, _MM_SHUFFLE( 3, 2, 3, 2 ) ); }
+    static reg scan( reg x ) {
+        return add( x, _mm_slli_si128( x, 8 ) );
+    }
+};
+
+template<>
+struct SimdScan<float> {
+    static constexpr bool enabled = true;
+    static constexpr size_t lanes = 4;
+    using reg = __m128;
+
+    static reg load( const float *p ) { return _mm_loadu_ps( p ); }
+    static void store( float *p, reg r ) { _mm_storeu_ps( p, r ); }
+    static reg set1( float v ) { return _mm_set1_ps( v ); }
+    static reg add( reg a, reg b ) { return _mm_add_ps( a, b ); }
+    static reg shiftLane( reg x ) { return _mm_castsi128_ps( _mm_slli_si128( _mm_castps_si128( x ), 4 ) ); }
+    static reg broadcastLast( reg x ) { return _mm_shuffle_ps( x, x, _MM_SHUFFLE( 3, 3, 3, 3 ) ); }
+    static reg scan( reg x ) {
+        x = add( x, shiftLane( x ) );
+        return add( x, _mm_castsi128_ps( _mm_slli_si128( _mm_castps_si128( x ), 8 ) ) );
+    }
+};
+
+template<>
+struct SimdScan<double> {
+    static constexpr bool enabled = true;
+    static constexpr size_t lanes = 2;
+    using reg = __m128d;
+
+    static reg load( const double *p ) { return _mm_loadu_pd( p ); }
+    static void store( double *p, reg r ) { _mm_storeu_pd( p, r ); }
+    static reg set1( double v ) { return _mm_set1_pd( v ); }
+    static reg add( reg a, reg b ) { return _mm_add_pd( a, b ); }
+    static reg shiftLane( reg x ) { return _mm_castsi128_pd( _mm_slli_si128( _mm_castpd_si128( x ), 8 ) ); }
+    static reg broadcastLast( reg x ) { return _mm_unpackhi_pd( x, x ); }
+    static reg scan( reg x ) {
+        return add( x, shiftLane( x ) );
+    }
+};
+
+#endif // __SSE2__
+
+//! Can [I, I) -> O scan with Fn be run by the vectorized kernel.
+template<class Fn, class I, class O, class T = typename std::iterator_traits<I>::value_type>
+using simd_scan_enabled = std::integral_constant<bool,
+    std::is_arithmetic<T>::value &&
+    SimdScan<T>::enabled &&
+    is_plus<T, Fn>::value &&
+    is_contiguous_iterator<I>::value &&
+    is_contiguous_iterator<O>::value &&
+    std::is_same<std::remove_cv_t<std::remove_reference_t<decltype( *std::declval<O>() )> >, T>::value >;
+
+//! Vectorized prefix sum over contiguous memory, carrying `carry` in. Safe in-place.
+template<bool Inclusive, class T>
+T simdScan( const T *in, T *out, size_t n, T carry ) {
+    using S = SimdScan<T>;
+    auto c = S::set1( carry );
+    size_t i = 0;
+
+    for ( ; i + S::lanes <= n; i += S::lanes ) {
+        auto s = S::scan( S::load( in + i ) );
+        S::store( out + i, S::add( Inclusive ? s : S::shiftLane( s ), c ) );
+        c = S::add( c, S::broadcastLast( s ) );
+    }
+
+    T lanes[S::lanes];
+    S::store( lanes, c );
+    carry = lanes[0];
+
+    for ( ; i < n; ++i ) {
+        T v = in[i];
+        if ( Inclusive ) {
+            out[i] = carry += v;
+        } else {
+            out[i] = carry;
+            carry += v;
+        }
+    }
+    return carry;
+}
+
+/**
+ * @brief Scan [b, e) into o, starting with accumulator acc.
+ *
+ * @return Accumulator after the last element (total of the scanned block).
+ */
+template<bool Inclusive, class Fn, class I, class O, class T>
+T scanBlock( Fn &fn, I b, I e, O o, T acc, std::false_type ) {
+    for ( ; b != e; ++b, ++o ) {
+        T v = *b; // read before the write, so the scan can run in-place.
+        if ( Inclusive ) {
+            acc = fn( acc, v );
+            *o = acc;
+        } else {
+            *o = acc;
+            acc = fn( acc, v );
+        }
     }
     return acc;
 }
 
+template<bool Inclusive, class Fn, class I, class O, class T>
+T scanBlock( Fn &, I b, I e, O o, T acc, std::true_type ) {
+    auto n = static_cast<size_t>( std::distance( b, e ) );
+    if ( n == 0 )
+        return acc;
+    return simdScan<Inclusive>( &*b, &*o, n, acc );
+}
+
+template<bool Inclusive, class Fn, class I, class O, class T>
+T scanBlock( Fn &fn, I b, I e, O o, T acc ) {
+    return scanBlock<Inclusive>( fn, b, e, o, acc, simd_scan_enabled<Fn, I, O>() );
+}
+
+//! Inclusive scan seeded by the first element.
+template<class Fn, class I, class O>
+auto seededScanBlock( Fn &fn, I b, I e, O o ) {
+    typename std::iterator_traits<I>::value_type acc = *b;
+    *o = acc;
+    return scanBlock<true>( fn, ++b, e, ++o, acc );
+}
+
+//! Smallest per-thread chunk worth spawning a thread for in parallel scans.
+constexpr size_t parallel_scan_grain = 1 << 15;
+
+/**
+ * @brief Two-pass (reduce-then-scan) parallel scan.
+ *
+ * First pass reduces each chunk to its total in parallel, chunk offsets are
+ * then scanned serially, and the second pass scans each chunk with its offset
+ * in parallel. When `init` is null, the scan is inclusive and seeded by the
+ * first element.
+ */
+template<bool Inclusive, class Fn, class I, class O, class T>
+T parallelScan( Fn &fn, I b, I e, O o, const T *init, size_t workers ) {
+    static_assert( std::is_base_of<std::random_access_iterator_tag,
+                   typename std::iterator_traits<I>::iterator_category>::value,
+                   "Parallel scan requires random access input." );
+
+    auto n = static_cast<size_t>( std::distance( b, e ) );
+    if ( workers == 0 )
+        workers = std::max( 1u, std::thread::hardware_concurrency() );
+    workers = std::min( workers, n / parallel_scan_grain );
+
+    if ( workers <= 1 )
+        return init ? scanBlock<Inclusive>( fn, b, e, o, *init ) : seededScanBlock( fn, b, e, o );
+
+    auto chunk = ( n + workers - 1 ) / workers;
+    workers = ( n + chunk - 1 ) / chunk;
+
+    std::vector<T> carry( workers );
+    std::vector<std::thread> threads;
+    threads.reserve( workers );
+
+    // first pass: chunk totals (the last chunk total is not needed).
+    for ( size_t w = 0; w + 1 < workers; ++w ) {
+        threads.emplace_back( [&, w]() {
+            auto cb = b + w * chunk;
+            auto ce = cb + chunk;
+            T acc = *cb;
+            while ( ++cb != ce )
+                acc = fn( acc, *cb );
+            carry[w + 1] = acc;
+        } );
+    }
+    for ( auto &t : threads )
+        t.join();
+    threads.clear();
+
+    // offsets of each chunk.
+    if ( init )
+        carry[0] = *init;
+    for ( size_t w = 1; w < workers; ++w )
+        carry[w] = ( w == 1 && !init ) ? carry[1] : fn( carry[w - 1], carry[w] );
+
+    // second pass: scan chunks with their offsets, last chunk on this thread.
+    auto scanChunk = [&]( size_t w ) {
+        auto cb = b + w * chunk;
+        auto ce = ( w + 1 == workers ) ? e : cb + chunk;
+        auto co = o;
+        std::advance( co, w * chunk );
+        if ( w == 0 && !init )
+            return seededScanBlock( fn, cb, ce, co );
+        return scanBlock<Inclusive>( fn, cb, ce, co, carry[w] );
+    };
+
+    for ( size_t w = 0; w + 1 < workers; ++w )
+        threads.emplace_back( [&, w]() { scanChunk( w ); } );
+    T total = scanChunk( workers - 1 );
+    for ( auto &t : threads )
+        t.join();
+
+    return total;
+}
+
+} // end of detail
+
+/**
+ * Generic range utility type.
+ *
+ * Represents a thin wrapper over generic iterator range, which is
+ * defined with `begin` and `end`.
+ */
+template<class I>
+struct GenericRange {
+
+public:
+    using iterator = I;
+    using value_type = typename std::iterator_traits<I>::value_type;
+    using pointer = typename std::iterator_traits<I>::pointer;
+    using referece = typename std::iterator_traits<I>::reference;
+
+private:
+    I _b, // beginning iterator of the range.
+    _e; // ending iterator of the range.
+
+public:
+    GenericRange() = delete; // void range is invalid.
+
+    //! Range constructor.
+    GenericRange( I b, I e ) : _b( b ), _e( e ) {}
+
+    //! Beginning of the range.
+    auto begin() {
+        return _b;
+    }
+
+    //! Ending of the range.
+    auto end() {
+        return _e;
+    }
+
+    //! Length of the range.
+    auto size() const {
+        return std::distance( _b, _e );
+    }
+
+    // Range utility wrappers.
+
+    template<class Fn> void each( Fn fn );
+    template<class Fn> GenericRange<detail::MapIterator<I, Fn> > map( Fn fn );
+    template<class T> GenericRange<detail::MapIterator<I, T( * )( value_type ) > > as();
+    template<class Fn> GenericRange<detail::FilterIterator<I, Fn> > filter( Fn fn );
+    GenericRange<detail::CachingIterator<I> > cache( size_t capacity = 0 );
+    template<class Fn> Selection select( Fn fn );
+    template<class Range, class Cmp = std::less<value_type> > auto merge( Range other, Cmp cmp = Cmp() );
+    template<class Range, class Cmp = std::less<value_type> > auto setUnion( Range other, Cmp cmp = Cmp() );
+    template<class Range, class Cmp = std::less<value_type> > auto setIntersection( Range other, Cmp cmp = Cmp() );
+    template<class Range, class Cmp = std::less<value_type> > auto setDifference( Range other, Cmp cmp = Cmp() );
+    template<class Fn> value_type reduce( Fn fn );
+    template<class Fn> value_type fold( Fn fn, value_type init );
+    template<class Fn> GenericRange<detail::ScanIterator<I, Fn> > scan( Fn fn, value_type init );
+    template<class Fn, class Out> value_type inclusiveScan( Fn fn, Out &&dest );
+    template<class Fn, class Out> value_type exclusiveScan( Fn fn, value_type init, Out &&dest );
+    GenericRange<I> take( size_t n );
+    GenericRange<I> drop( size_t n = 1 );
+    GenericRange<I> tail( size_t n );
+    template<class O> void copyTo( GenericRange<O> other ) const;
+    template<class Range> void copyTo( Range &other ) const;
+    auto tile( size_t tile_length );
+    auto flatten();
+    template<class T> auto join( T separator );
+    GenericRange<detail::SplitIterator<I> > split( value_type delimiter );
+    template<class Fn> auto incremental( Fn fn );
+};
+
+template<class T>
+struct is_generic_range : std::false_type {};
+
+template<class I>
+struct is_generic_range<GenericRange<I> > : std::true_type {};
+
+//! Generic range wrapper constructor.
+template<class I>
+auto range( I begin, I end ) {
+    return GenericRange<I>( begin, end );
+}
+
+//! Generic range wrapper constructor.
+template<class Range>
+auto range( Range &r ) {
+    return GenericRange<typename Range::iterator>( r.begin(), r.end() );
+}
+
+//! Generic range wrapper constructor.
+template<class Range>
+auto range( const Range &r ) {
+    return GenericRange<typename Range::const_iterator>( r.begin(), r.end() );
+}
+
+//! Owning range wrapper constructor. Adopts a temporary container, kept alive by the range iterators.
+template<class Range, class = std::enable_if_t<!std::is_lvalue_reference<Range>::value &&
+                                               !std::is_const<Range>::value &&
+                                               !is_generic_range<Range>::value> >
+auto range( Range &&r ) {
+    using Oi = detail::OwningIterator<Range>;
+    auto owner = std::make_shared<Range>( std::move( r ) );
+    return GenericRange<Oi>( Oi( owner->begin(), owner ), Oi( owner->end(), owner ) );
+}
+
+namespace detail {
+
+//! Value type of a range, or of a reference to one.
+template<class Range>
+using range_value_t = typename std::decay_t<Range>::value_type;
+
+//! Generic ranges are views already, copying them is cheap.
+template<class I>
+GenericRange<I> view( GenericRange<I> r ) {
+    return r;
+}
+
+//! Other ranges (containers) are referenced when lvalues, and adopted when temporaries.
+template<class Range, class = std::enable_if_t<!is_generic_range<std::decay_t<Range> >::value> >
+auto view( Range &&r ) {
+    return ::range( std::forward<Range>( r ) );
+}
+
+} // end of detail
+
+/**
+ * Selection vector.
+ *
+ * Holds indices of range elements which satisfy a predicate. Predicate is
+ * evaluated block by block into a mask, and the mask is compacted into
+ * indices without branching, so the cost does not depend on selectivity.
+ *
+ * Selection can be reused to gather, or compact, any range of the same
+ * length as the one it was made from - e.g. other columns of a table.
+ * Gathered ranges refer to the selection, which has to outlive them.
+ */
+class Selection {
+    std::vector<size_t> _indices;
+    size_t _source_size;
+
+public:
+    using iterator = std::vector<size_t>::const_iterator;
+
+    //! Evaluate predicate over the range, and store indices of passing elements.
+    template<class Fn, class Range>
+    Selection( Fn fn, Range range ) : _source_size( static_cast<size_t>( range.size() ) ) {
+        unsigned char mask[detail::selection_block];
+        size_t local[detail::selection_block];
+
+        auto it = range.begin();
+        for ( size_t base = 0; base < _source_size; base += detail::selection_block ) {
+            auto m = std::min( detail::selection_block, _source_size - base );
+
+            for ( size_t i = 0; i < m; ++i, ++it ) {
+                mask[i] = static_cast<unsigned char>( static_cast<bool>( fn( *it ) ) );
+            }
+
+            size_t count = 0;
+            for ( size_t i = 0; i < m; ++i ) {
+                local[count] = base + i;
+                count += mask[i];
+            }
+
+            _indices.insert( _indices.end(), local, local + count );
+        }
+    }
+
+    //! Number of selected elements.
+    size_t size() const {
+        return _indices.size();
+    }
+
+    //! Length of the range selection was made from.
+    size_t sourceSize() const {
+        return _source_size;
+    }
+
+    //! Beginning of the selected indices.
+    iterator begin() const {
+        return _indices.begin();
+    }
+
+    //! Ending of the selected indices.
+    iterator end() const {
+        return _indices.end();
+    }
+
+    /**
+     * @brief Lazy range of selected elements of given range.
+     *
+     * @param range Random access range, of the same length as the source range.
+     *
+     * @return Range of selected elements, writable if the given range is.
+     */
+    template<class Range>
+    auto gather( Range &&range ) const {
+        auto r = detail::view( std::forward<Range>( range ) );
+        assert( static_cast<size_t>( r.size() ) == _source_size );
+        using Gi = detail::GatherIterator<typename decltype( r )::iterator>;
+        return GenericRange<Gi>(
+                   Gi( _indices.data(), r.begin() ),
+                   Gi( _indices.data() + _indices.size(), r.begin() )
+               );
+    }
+
+    /**
+     * @brief Copy selected elements of given range to the destination.
+     *
+     * @param range Random access range, of the same length as the source range.
+     * @param dest Destination range, of at least the size of the selection.
+     *
+     * @return Number of copied elements.
+     */
+    template<class Range, class Out>
+    size_t compactTo( Range &&range, Out &&dest ) const {
+        auto r = detail::view( std::forward<Range>( range ) );
+        assert( static_cast<size_t>( r.size() ) == _source_size );
+        assert( static_cast<size_t>( dest.size() ) >= _indices.size() );
+        auto b = r.begin();
+        auto o = dest.begin();
+        for ( auto i : _indices ) {
+            *( o++ ) = *( b + i );
+        }
+        return _indices.size();
+    }
+};
+
+/**
+ * @brief Tile the range to sub-ranges of given lenght.
+ *
+ * @param range Range to be tiled.
+ * @param tile_size Size of tile.
+ *
+ * @return Range of tiles.
+ */
+template<class Range>
+auto tile( Range &&range, size_t tile_size ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    int el = static_cast<int>( r.size() );
+    el -= el % tile_size;
+
+    assert( el > 0 );
+
+    using I = detail::TilingIterator<typename decltype( r )::iterator>;
+
+    return GenericRange<I>(
+               I( r.begin(), r.begin() + tile_size ),
+               I( r.begin() + el, r.end() )
+           );
+}
+
+/**
+ * @brief Split a range by given delimiter.
+ *
+ * @param range Range to be split.
+ * @param delimiter Delimiter value by which to split the range.
+ *
+ * @return Range of sub-ranges split by given delimiter.
+ */
+template<class Range>
+auto split( Range &&range, detail::range_value_t<Range> delimiter ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using I = typename decltype( r )::iterator;
+    return GenericRange<detail::SplitIterator<I> >(
+               detail::SplitIterator<I>( r.begin(), r.end(), delimiter ),
+               detail::SplitIterator<I>( r.end(), r.end(), delimiter )
+           );
+}
+
+/**
+ * @brief Flatten a range of ranges (e.g. tiles or split parts) to a range of their elements.
+ *
+ * Terminal operations (`each`, `fold`, `reduce`, `copyTo`) run a plain
+ * loop over each segment, so flattening costs about as much as a raw loop.
+ *
+ * @param range Range of ranges.
+ *
+ * @return Lazy flattening range.
+ */
+template<class Range>
+auto flatten( Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using Fi = detail::FlattenIterator<typename decltype( r )::iterator>;
+    using T = typename Fi::value_type;
+    return GenericRange<Fi>(
+               Fi( r.begin(), r.end(), false, T() ),
+               Fi( r.end(), r.end(), false, T() )
+           );
+}
+
+/**
+ * @brief Join a range of ranges, with a separator between them.
+ *
+ * Separator is yielded between every two consecutive segments,
+ * empty segments included.
+ *
+ * @param range Range of ranges.
+ * @param separator Element yielded between segments.
+ *
+ * @return Lazy joining range.
+ */
+template<class Range>
+auto join( Range &&range, typename std::iterator_traits<typename std::decay_t<Range>::iterator>::value_type::value_type separator ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using Fi = detail::FlattenIterator<typename decltype( r )::iterator>;
+    return GenericRange<Fi>(
+               Fi( r.begin(), r.end(), true, separator ),
+               Fi( r.end(), r.end(), true, separator )
+           );
+}
+
+/**
+ * @brief Range (sequence) of integral values.
+ *
+ * @param start Start of the sequence.
+ * @param end End of sequence.
+ * @param jump Stride value from one to the next value in sequence.
+ *
+ * @return Lazy range (sequence) of values.
+ */
+template<class I, class J = I>
+auto iota( I start, I end, J jump = J( 1 ) ) {
+    static_assert(std::is_integral<I>::value && std::is_integral<J>::value, 
+            "Value types have to be integral.");
+    return GenericRange<detail::IotaIterator<I, J> >(
+               detail::IotaIterator<I, J>( start, jump ),
+               detail::IotaIterator<I, J>( end, jump )
+           );
+}
+
+//! Integral sequence from 0 to given number, by jump of 1.
+template<class I>
+auto iota( I count ) {
+    return ::iota(0, count, 1);
+}
+
+/**
+ * @brief Apply function mapping to the data range.
+ *
+ * Create lazy mapping range. Function is applied to
+ * range elements lazily as they are accesed, generating
+ * a resulting range.
+ *
+ * @param fn Function.
+ * @param range Data range.
+ *
+ * @param Lazy mapping range.
+ */
+template<class Range, class Fn>
+auto map( Fn fn, Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using I = typename decltype( r )::iterator;
+    using Mi = detail::MapIterator<I, Fn>;
+
+    detail::Stage<Fn> stage( std::move( fn ) );
+    return GenericRange<Mi>(
+               Mi( r.begin(), stage ),
+               Mi( r.end(), stage )
+           );
+}
+
+/**
+ * @brief Apply data reduction with given function.
+ *
+ * @param fn Reduction function.
+ * @param range Range to reduce.
+ *
+ * @return Reduction value.
+ */
+template<class Fn, class Range>
+auto reduce( Fn fn, Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    auto b = r.begin();
+    assert( b != r.end() );
+    detail::range_value_t<Range> acc = *b;
+    return detail::foldRange( ++b, r.end(), acc, fn );
+}
+
 /**
  * @brief Apply data folding with given function, and given initial accumulator value.
  *
@@ -504,14 +1907,106 @@ auto reduce( Fn fn, Range range ) {
  * @param init Initial accumulator value.
  * @param range Range to reduce.
  *
- * @return Reduction value.
+ * @return Reduction value.
+ */
+template<class Fn, class Range>
+auto fold( Fn fn, detail::range_value_t<Range> acc, Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    return detail::foldRange( r.begin(), r.end(), acc, fn );
+}
+
+/**
+ * @brief Lazy inclusive prefix scan.
+ *
+ * Each element of the resulting range is the fold of `init` and all
+ * elements of the source range up to, and including, the current one.
+ *
+ * @param fn Accumulation function.
+ * @param init Initial accumulator value.
+ * @param range Range to scan.
+ *
+ * @return Lazy scanning range.
+ */
+template<class Fn, class Range>
+auto scan( Fn fn, detail::range_value_t<Range> init, Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using I = typename decltype( r )::iterator;
+    using Si = detail::ScanIterator<I, Fn>;
+
+    detail::Stage<Fn> stage( std::move( fn ) );
+    return GenericRange<Si>(
+               Si( r.begin(), r.end(), stage, init ),
+               Si( r.end(), r.end(), stage, init )
+           );
+}
+
+/**
+ * @brief Eager inclusive prefix scan into destination range.
+ *
+ * Writes `x0`, `fn(x0, x1)`, `fn(fn(x0, x1), x2)`... to the destination,
+ * which may be the source range itself. Passing `std::plus<>` over contiguous
+ * arithmetic data uses a vectorized kernel.
+ *
+ * @param fn Accumulation function.
+ * @param range Range to scan.
+ * @param dest Destination range, of at least the size of the source range.
+ *
+ * @return Total, i.e. the last written value.
+ */
+template<class Fn, class Range, class Out>
+auto inclusiveScan( Fn fn, Range &&range, Out &&dest ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    assert( r.size() > 0 );
+    assert( static_cast<size_t>( r.size() ) <= static_cast<size_t>( dest.size() ) );
+    return detail::seededScanBlock( fn, r.begin(), r.end(), dest.begin() );
+}
+
+/**
+ * @brief Eager exclusive prefix scan into destination range.
+ *
+ * Writes `init`, `fn(init, x0)`, `fn(fn(init, x0), x1)`... to the destination.
+ *
+ * @param fn Accumulation function.
+ * @param init Initial accumulator value.
+ * @param range Range to scan.
+ * @param dest Destination range, of at least the size of the source range.
+ *
+ * @return Total, i.e. the fold of init and all elements of the range.
+ */
+template<class Fn, class Range, class Out>
+auto exclusiveScan( Fn fn, detail::range_value_t<Range> init, Range &&range, Out &&dest ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    assert( static_cast<size_t>( r.size() ) <= static_cast<size_t>( dest.size() ) );
+    return detail::scanBlock<false>( fn, r.begin(), r.end(), dest.begin(), init );
+}
+
+/**
+ * @brief Parallel inclusive prefix scan of a random access range.
+ *
+ * Runs a two-pass, reduce-then-scan algorithm over `workers` threads. The
+ * function has to be associative and safe to call concurrently. Small ranges
+ * are scanned serially.
+ *
+ * @param workers Number of threads, 0 for hardware concurrency.
+ *
+ * @return Total, i.e. the last written value.
  */
-template<class Fn, class Range>
-auto fold( Fn fn, typename Range::value_type acc, Range range ) {
-    for ( auto const &i : range ) {
-        acc = fn( acc, i );
-    }
-    return acc;
+template<class Fn, class Range, class Out>
+auto parallelInclusiveScan( Fn fn, Range &&range, Out &&dest, size_t workers = 0 ) {
+    using T = detail::range_value_t<Range>;
+    auto r = detail::view( std::forward<Range>( range ) );
+    assert( r.size() > 0 );
+    assert( static_cast<size_t>( r.size() ) <= static_cast<size_t>( dest.size() ) );
+    return detail::parallelScan<true>( fn, r.begin(), r.end(), dest.begin(),
+                                       static_cast<const T *>( nullptr ), workers );
+}
+
+//! Parallel exclusive prefix scan of a random access range. See parallelInclusiveScan.
+template<class Fn, class Range, class Out>
+auto parallelExclusiveScan( Fn fn, detail::range_value_t<Range> init, Range &&range, Out &&dest, size_t workers = 0 ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    assert( static_cast<size_t>( r.size() ) <= static_cast<size_t>( dest.size() ) );
+    return detail::parallelScan<false>( fn, r.begin(), r.end(), dest.begin(), &init, workers );
 }
 
 /**
@@ -527,16 +2022,170 @@ auto fold( Fn fn, typename Range::value_type acc, Range range ) {
  * @return Lazy filtering range.
  */
 template<class Range, class Fn>
-auto filter( Fn fn, Range range ) {
-    using I = typename Range::iterator;
+auto filter( Fn fn, Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using I = typename decltype( r )::iterator;
     using Mi = detail::FilterIterator<I, Fn>;
 
+    detail::Stage<Fn> stage( std::move( fn ) );
+    return GenericRange<Mi>(
+               Mi( r.begin(), r.end(), stage ),
+               Mi( r.end(), r.end(), stage )
+           );
+}
+
+/**
+ * @brief Memoize values of the range.
+ *
+ * Each element of the resulting range is evaluated at most once per
+ * position an iterator visits, no matter how many times it is dereferenced -
+ * e.g. by a `filter` further down the pipeline. Put it after an expensive `map`.
+ *
+ * Random access ranges can additionally keep the first `capacity` values in
+ * a buffer shared by all iterators of the range, so that they are evaluated
+ * once across repeated traversals. Value type has to be default constructible.
+ *
+ * @param range Range to be cached.
+ * @param capacity Maximal number of materialized values, used only for random access ranges.
+ *
+ * @return Lazy caching range.
+ */
+template<class Range>
+auto cache( Range &&range, size_t capacity = 0 ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    using I = typename decltype( r )::iterator;
+    using Ci = detail::CachingIterator<I>;
+    using T = typename Ci::value_type;
+
+    if ( !std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<I>::iterator_category>::value )
+        capacity = 0;
+    if ( capacity )
+        capacity = std::min( capacity, static_cast<size_t>( r.size() ) );
+
+    auto state = std::make_shared<detail::CacheState<T> >( capacity );
+    return GenericRange<Ci>(
+               Ci( r.begin(), r.begin(), state ),
+               Ci( r.end(), r.begin(), state )
+           );
+}
+
+//! Evaluation counters of a caching range, i.e. how many evaluations were saved.
+template<class I>
+CacheStats cacheStats( GenericRange<detail::CachingIterator<I> > range ) {
+    return range.begin().stats();
+}
+
+/**
+ * @brief Branch-free filtering into a selection vector.
+ *
+ * Eagerly evaluates criteria function over blocks of the range,
+ * and collects indices of passing elements. Unlike lazy `filter`,
+ * throughput doesn't depend on how many elements pass.
+ *
+ * @param fn Criteria function.
+ * @param range Range to be filtered.
+ *
+ * @return Selection vector, to gather or compact this or other ranges of the same length.
+ */
+template<class Range, class Fn>
+Selection select( Fn fn, Range &&range ) {
+    return Selection( std::move( fn ), detail::view( std::forward<Range>( range ) ) );
+}
+
+/**
+ * @brief Merge two sorted ranges.
+ *
+ * Lazily yields all elements of both ranges in sorted order. Equivalent
+ * elements are yielded first from the first range.
+ *
+ * @param a First sorted range.
+ * @param b Second sorted range.
+ * @param cmp Comparison by which both ranges are sorted.
+ *
+ * @return Lazy merging range.
+ */
+template<class R1, class R2, class Cmp = std::less<detail::range_value_t<R1> > >
+auto merge( R1 &&first, R2 &&second, Cmp cmp = Cmp() ) {
+    auto a = detail::view( std::forward<R1>( first ) );
+    auto b = detail::view( std::forward<R2>( second ) );
+    using Mi = detail::MergeIterator<typename decltype( a )::iterator, typename decltype( b )::iterator, Cmp, false>;
+
+    detail::Stage<Cmp> stage( std::move( cmp ) );
+    return GenericRange<Mi>(
+               Mi( a.begin(), a.end(), b.begin(), b.end(), stage ),
+               Mi( a.end(), a.end(), b.end(), b.end(), stage )
+           );
+}
+
+//! Lazy union of two sorted ranges. Elements present in both are yielded once, from the first range.
+template<class R1, class R2, class Cmp = std::less<detail::range_value_t<R1> > >
+auto setUnion( R1 &&first, R2 &&second, Cmp cmp = Cmp() ) {
+    auto a = detail::view( std::forward<R1>( first ) );
+    auto b = detail::view( std::forward<R2>( second ) );
+    using Mi = detail::MergeIterator<typename decltype( a )::iterator, typename decltype( b )::iterator, Cmp, true>;
+
+    detail::Stage<Cmp> stage( std::move( cmp ) );
     return GenericRange<Mi>(
-               Mi( range.begin(), range.end(), fn ),
-               Mi( range.end(), range.end(), fn )
+               Mi( a.begin(), a.end(), b.begin(), b.end(), stage ),
+               Mi( a.end(), a.end(), b.end(), b.end(), stage )
            );
 }
 
+/**
+ * @brief Lazy intersection of two sorted ranges.
+ *
+ * When both ranges are random access, and their sizes differ by
+ * `detail::gallop_ratio` or more, mismatches are skipped with exponential
+ * search instead of stepping element by element.
+ */
+template<class R1, class R2, class Cmp = std::less<detail::range_value_t<R1> > >
+auto setIntersection( R1 &&first, R2 &&second, Cmp cmp = Cmp() ) {
+    auto a = detail::view( std::forward<R1>( first ) );
+    auto b = detail::view( std::forward<R2>( second ) );
+    using Ii = detail::IntersectionIterator<typename decltype( a )::iterator, typename decltype( b )::iterator, Cmp>;
+
+    auto galloping = detail::shouldGallop( a, b );
+    detail::Stage<Cmp> stage( std::move( cmp ) );
+    return GenericRange<Ii>(
+               Ii( a.begin(), a.end(), b.begin(), b.end(), stage, galloping ),
+               Ii( a.end(), a.end(), b.end(), b.end(), stage, galloping )
+           );
+}
+
+//! Lazy difference of two sorted ranges, i.e. elements of the first range not in the second.
+template<class R1, class R2, class Cmp = std::less<detail::range_value_t<R1> > >
+auto setDifference( R1 &&first, R2 &&second, Cmp cmp = Cmp() ) {
+    auto a = detail::view( std::forward<R1>( first ) );
+    auto b = detail::view( std::forward<R2>( second ) );
+    using Di = detail::DifferenceIterator<typename decltype( a )::iterator, typename decltype( b )::iterator, Cmp>;
+
+    auto galloping = detail::shouldGallop( a, b );
+    detail::Stage<Cmp> stage( std::move( cmp ) );
+    return GenericRange<Di>(
+               Di( a.begin(), a.end(), b.begin(), b.end(), stage, galloping ),
+               Di( a.end(), a.end(), b.end(), b.end(), stage, galloping )
+           );
+}
+
+/**
+ * @brief Merge many sorted ranges.
+ *
+ * Runs a tournament (loser) tree over the ranges, so that each element
+ * costs log2(k) comparisons for k ranges. Equivalent elements are yielded
+ * in order of the ranges they come from.
+ *
+ * @param ranges Sorted ranges of the same type.
+ * @param cmp Comparison by which all ranges are sorted.
+ *
+ * @return Lazy merging range.
+ */
+template<class I, class Cmp = std::less<typename std::iterator_traits<I>::value_type> >
+auto kwayMerge( std::vector<GenericRange<I> > ranges, Cmp cmp = Cmp() ) {
+    using Ki = detail::KWayMergeIterator<I, Cmp>;
+    detail::Stage<Cmp> stage( std::move( cmp ) );
+    return GenericRange<Ki>( Ki( ranges, stage ), Ki( stage ) );
+}
+
 /**
  * @brief Take first few elements from a range.
  *
@@ -584,9 +2233,7 @@ template<class Range, class Fn>
 std::enable_if_t<is_generic_range<Range>::value, void>
 each( Fn fn, Range range ) {
     // special case for generic ranges that follow copy-on-pass semantics.
-    for ( auto e : range ) {
-        fn( e );
-    }
+    detail::eachRange( range.begin(), range.end(), fn );
 }
 
 template<class Range, class Fn>
@@ -617,6 +2264,492 @@ auto byLine( String &string ) {
            );
 }
 
+/**
+ * Type-erased range of values of type T.
+ *
+ * Holds any range with elements convertible to T behind a single type,
+ * so pipelines can be passed across compilation units without spelling
+ * out, or instantiating, their nested iterator types. Small ranges are
+ * stored inline, bigger ones on the heap.
+ *
+ * Elements are pulled from the erased range in blocks of
+ * `detail::any_range_block` per virtual call. Terminal operations (each,
+ * fold, reduce, copyTo) run their loops over those blocks, so indirection
+ * cost is amortized, and they should be preferred: iterating with a
+ * range-for, or through range(), steps the iterator per element, which is
+ * several times slower.
+ */
+template<class T>
+class AnyRange {
+    using Source = detail::AnySource<T>;
+
+    static constexpr size_t storage_size = 96;
+
+    std::aligned_storage_t<storage_size> _storage;
+    Source *_source;
+
+    AnyRange() : _source( nullptr ) {}
+
+    bool inlined() const {
+        return static_cast<const void *>( _source ) == static_cast<const void *>( &_storage );
+    }
+
+    void release() {
+        if ( !_source )
+            return;
+        if ( inlined() )
+            _source->~Source();
+        else
+            delete _source;
+        _source = nullptr;
+    }
+
+    void take( AnyRange &other ) {
+        if ( other._source && !other.inlined() ) {
+            _source = other._source;
+            other._source = nullptr;
+        } else {
+            _source = other._source ? other._source->clone( &_storage, storage_size ) : nullptr;
+        }
+    }
+
+public:
+    using value_type = T;
+
+    /*
+     * Forward iterator, buffering one block of elements. Each iterator owns
+     * a copy of the source, so copies traverse independently (and cost a
+     * source copy, plus a block of elements).
+     */
+    class iterator :
+        public std::iterator<std::forward_iterator_tag, T, ptrdiff_t, const T *, const T &> {
+
+        AnyRange cursor; // empty for the end iterator.
+        T block[detail::any_range_block];
+        size_t pos, count,
+               offset; // index of the first block element in the range.
+
+        void refill() {
+            offset += count;
+            pos = 0;
+            count = cursor._source->fill( block, detail::any_range_block );
+        }
+
+        void assign( const iterator &other ) {
+            cursor.release();
+            if ( other.cursor._source )
+                cursor._source = other.cursor._source->fork( &cursor._storage, storage_size );
+            pos = other.pos;
+            count = other.count;
+            offset = other.offset;
+            std::copy( other.block, other.block + count, block );
+        }
+
+    public:
+        iterator() : pos( 0 ), count( 0 ), offset( 0 ) {}
+        explicit iterator( const AnyRange &range ) : cursor( range ), pos( 0 ), count( 0 ), offset( 0 ) {
+            refill();
+        }
+
+        iterator( const iterator &other ) {
+            assign( other );
+        }
+
+        iterator &operator=( const iterator &other ) {
+            if ( this != &other )
+                assign( other );
+            return *this;
+        }
+
+        const T &operator*() const {
+            return block[pos];
+        }
+
+        iterator &operator++() {
+            if ( ++pos == count )
+                refill();
+            return *this;
+        }
+
+        iterator operator++( int ) {
+            auto t( *this );
+            operator++();
+            return t;
+        }
+
+        bool operator==( const iterator &other ) const {
+            bool done = pos == count, other_done = other.pos == other.count;
+            return done || other_done ? done == other_done : offset + pos == other.offset + other.pos;
+        }
+        bool operator!=( const iterator &other ) const {
+            return !operator==( other );
+        }
+    };
+
+    //! Erase type of given range.
+    template<class Range, class = std::enable_if_t<!std::is_same<std::decay_t<Range>, AnyRange>::value> >
+    AnyRange( Range range ) {
+        // held as a view (containers adopted), so that sources can be forked.
+        auto r = detail::view( std::move( range ) );
+        _source = detail::AnySourceImpl<T, decltype( r )>::emplace( &_storage, storage_size, r );
+    }
+
+    AnyRange( const AnyRange &other ) : _source( nullptr ) {
+        if ( other._source )
+            _source = other._source->clone( &_storage, storage_size );
+    }
+
+    AnyRange( AnyRange &&other ) : _source( nullptr ) {
+        take( other );
+    }
+
+    AnyRange &operator=( AnyRange other ) {
+        release();
+        take( other );
+        return *this;
+    }
+
+    ~AnyRange() {
+        release();
+    }
+
+    //! Beginning of the range.
+    iterator begin() const {
+        return iterator( *this );
+    }
+
+    //! Ending of the range.
+    iterator end() const {
+        return iterator();
+    }
+
+    //! Length of the range.
+    size_t size() const {
+        return _source->size();
+    }
+
+    //! Evaluate given unary function on each element of the range.
+    template<class Fn>
+    void each( Fn fn ) const {
+        AnyRange cursor( *this );
+        T block[detail::any_range_block];
+        while ( auto n = cursor._source->fill( block, detail::any_range_block ) ) {
+            for ( size_t i = 0; i < n; ++i ) {
+                fn( block[i] );
+            }
+        }
+    }
+
+    //! Fold the range with given function and initial accumulator value.
+    template<class Fn>
+    T fold( Fn fn, T acc ) const {
+        AnyRange cursor( *this );
+        T block[detail::any_range_block];
+        while ( auto n = cursor._source->fill( block, detail::any_range_block ) ) {
+            for ( size_t i = 0; i < n; ++i ) {
+                acc = fn( acc, block[i] );
+            }
+        }
+        return acc;
+    }
+
+    //! Reduce the range with given function.
+    template<class Fn>
+    T reduce( Fn fn ) const {
+        AnyRange cursor( *this );
+        T block[detail::any_range_block];
+        auto n = cursor._source->fill( block, detail::any_range_block );
+        assert( n > 0 );
+        T acc = block[0];
+        for ( size_t i = 1; i < n; ++i ) {
+            acc = fn( acc, block[i] );
+        }
+        while ( ( n = cursor._source->fill( block, detail::any_range_block ) ) ) {
+            for ( size_t i = 0; i < n; ++i ) {
+                acc = fn( acc, block[i] );
+            }
+        }
+        return acc;
+    }
+
+    //! Copy elements to other range, of the same size.
+    template<class Range>
+    void copyTo( Range &&other ) const {
+        assert( size() == static_cast<size_t>( other.size() ) );
+        AnyRange cursor( *this );
+        auto oi = other.begin();
+        T block[detail::any_range_block];
+        while ( auto n = cursor._source->fill( block, detail::any_range_block ) ) {
+            for ( size_t i = 0; i < n; ++i ) {
+                *( oi++ ) = block[i];
+            }
+        }
+    }
+};
+
+/*
+ * Incremental reduction over a random access range.
+ *
+ * Keeps an implicit, bottom-up segment tree of partial reductions in one
+ * contiguous array of 2n values (leaf of element i at n + i, node k
+ * combining nodes 2k and 2k + 1), so that after a point update only the
+ * O(log n) ancestors of the leaf are recomputed, and any sub-range
+ * reduction combines O(log n) nodes.
+ *
+ * Reduction function has to be associative. It does not have to be
+ * commutative, nor to have an identity or an inverse - operands are
+ * always combined in range order.
+ */
+template<class Range, class Fn>
+class IncrementalReducer {
+public:
+    using value_type = typename Range::value_type;
+
+private:
+    Range _range;
+    Fn _fn;
+    size_t _size;
+    std::vector<value_type> _tree;
+
+    static_assert( std::is_base_of<std::random_access_iterator_tag,
+                   typename std::iterator_traits<typename Range::iterator>::iterator_category>::value,
+                   "Incremental reduction requires a random access range." );
+
+    void combine( size_t k ) {
+        _tree[k] = _fn( _tree[2 * k], _tree[2 * k + 1] );
+    }
+
+    void rebuild() {
+        for ( size_t k = _size - 1; k > 0; --k ) {
+            combine( k );
+        }
+    }
+
+    // Recompute ancestors of given leaves, each at most once, children first.
+    template<class Indices>
+    void repair( Indices indices, size_t count ) {
+        size_t depth = 0;
+        for ( auto n = _size; n; n >>= 1 ) {
+            ++depth;
+        }
+        if ( count * depth >= _size ) {
+            rebuild();
+            return;
+        }
+
+        std::vector<size_t> nodes;
+        nodes.reserve( count * depth );
+        for ( auto i = indices.begin(); i != indices.end(); ++i ) {
+            for ( auto k = ( _size + static_cast<size_t>( *i ) ) >> 1; k > 0; k >>= 1 ) {
+                nodes.push_back( k );
+            }
+        }
+        std::sort( nodes.begin(), nodes.end(), std::greater<size_t>() );
+        nodes.erase( std::unique( nodes.begin(), nodes.end() ), nodes.end() );
+        for ( auto k : nodes ) {
+            combine( k );
+        }
+    }
+
+public:
+    /*
+     * Reduction of a contiguous sub-range of the reducer, with take, drop
+     * and tail behaving as they do on GenericRange. Refers to the
+     * reducer, which has to outlive it.
+     */
+    class Window {
+        const IncrementalReducer *_reducer;
+        size_t _first, _last;
+
+    public:
+        Window( const IncrementalReducer *reducer, size_t first, size_t last ) :
+            _reducer( reducer ), _first( first ), _last( last ) {}
+
+        //! Index of the first element of the window, in the wrapped range.
+        size_t first() const {
+            return _first;
+        }
+
+        //! Length of the window.
+        size_t size() const {
+            return _last - _first;
+        }
+
+        //! Reduction of the window, in O(log n).
+        value_type reduce() const {
+            return _reducer->reduce( _first, _last );
+        }
+
+        //! Take first few elements of the window.
+        Window take( size_t n ) const {
+            assert( n > 0 );
+            assert( n <= size() );
+            return Window( _reducer, _first, _first + n );
+        }
+
+        //! Drop first few elements of the window.
+        Window drop( size_t n = 1 ) const {
+            assert( n < size() );
+            return Window( _reducer, _first + n, _last );
+        }
+
+        //! Take the tail of the window.
+        Window tail( size_t n ) const {
+            assert( n > 0 );
+            assert( n <= size() );
+            return Window( _reducer, _last - n, _last );
+        }
+    };
+
+    //! Build the tree over given range, in O(n).
+    IncrementalReducer( Fn fn, Range range ) :
+        _range( range ), _fn( std::move( fn ) ), _size( static_cast<size_t>( range.size() ) ),
+        _tree( 2 * _size ) {
+        assert( _size > 0 );
+        detail::copyRange( _range.begin(), _range.end(), _tree.begin() + _size );
+        rebuild();
+    }
+
+    //! Length of the wrapped range.
+    size_t size() const {
+        return _size;
+    }
+
+    //! Current value of i-th element, as seen by the reducer.
+    value_type operator[]( size_t i ) const {
+        assert( i < _size );
+        return _tree[_size + i];
+    }
+
+    //! Reduction of the whole range, in O(log n).
+    value_type reduce() const {
+        return reduce( 0, _size );
+    }
+
+    //! Reduction of elements in [first, last), in O(log n).
+    value_type reduce( size_t first, size_t last ) const {
+        assert( first < last );
+        assert( last <= _size );
+
+        // seeded with boundary leaves, so that no identity value is needed.
+        auto l = _size + first, r = _size + last - 1;
+        if ( l == r )
+            return _tree[l];
+
+        value_type left = _tree[l++];
+        value_type right = _tree[r];
+        for ( ; l < r; l >>= 1, r >>= 1 ) {
+            if ( l & 1 )
+                left = _fn( left, _tree[l++] );
+            if ( r & 1 )
+                right = _fn( _tree[--r], right );
+        }
+        return _fn( left, right );
+    }
+
+    //! Window over the whole range.
+    Window window() const {
+        return Window( this, 0, _size );
+    }
+
+    //! Window over first few elements.
+    Window take( size_t n ) const {
+        return window().take( n );
+    }
+
+    //! Window without first few elements.
+    Window drop( size_t n = 1 ) const {
+        return window().drop( n );
+    }
+
+    //! Window over last few elements.
+    Window tail( size_t n ) const {
+        return window().tail( n );
+    }
+
+    //! Assign to i-th element of the wrapped range, and update the tree in O(log n).
+    void update( size_t i, value_type value ) {
+        assert( i < _size );
+        *( _range.begin() + i ) = value;
+        refresh( i );
+    }
+
+    /**
+     * @brief Assign to many elements of the wrapped range, and update the tree in bulk.
+     *
+     * All leaves are written first, and then each affected node is
+     * recomputed once. When the batch touches a large part of the tree,
+     * it is rebuilt in a single O(n) pass instead.
+     *
+     * @param indices Range of element indices.
+     * @param values Range of new values, of the same length as indices.
+     */
+    template<class Indices, class Values, class = std::enable_if_t<!std::is_arithmetic<std::decay_t<Indices> >::value> >
+    void update( Indices &&indices, Values &&values ) {
+        auto ir = detail::view( std::forward<Indices>( indices ) );
+        auto vr = detail::view( std::forward<Values>( values ) );
+        assert( ir.size() == vr.size() );
+
+        auto begin = _range.begin();
+        auto v = vr.begin();
+        size_t count = 0;
+        for ( auto i = ir.begin(); i != ir.end(); ++i, ++v, ++count ) {
+            auto index = static_cast<size_t>( *i );
+            assert( index < _size );
+            *( begin + index ) = *v;
+            _tree[_size + index] = *v;
+        }
+        repair( ir, count );
+    }
+
+    //! Re-read i-th element from the wrapped range (e.g. after it was written directly), in O(log n).
+    void refresh( size_t i ) {
+        assert( i < _size );
+        auto k = _size + i;
+        _tree[k] = *( _range.begin() + i );
+        for ( k >>= 1; k > 0; k >>= 1 ) {
+            combine( k );
+        }
+    }
+
+    //! Re-read given elements from the wrapped range, and update the tree in bulk.
+    template<class Indices, class = std::enable_if_t<!std::is_arithmetic<std::decay_t<Indices> >::value> >
+    void refresh( Indices &&indices ) {
+        auto ir = detail::view( std::forward<Indices>( indices ) );
+        auto begin = _range.begin();
+        size_t count = 0;
+        for ( auto i = ir.begin(); i != ir.end(); ++i, ++count ) {
+            auto index = static_cast<size_t>( *i );
+            assert( index < _size );
+            _tree[_size + index] = *( begin + index );
+        }
+        repair( ir, count );
+    }
+
+    //! Re-read the whole wrapped range, and rebuild the tree in O(n).
+    void refresh() {
+        detail::copyRange( _range.begin(), _range.end(), _tree.begin() + _size );
+        rebuild();
+    }
+};
+
+/**
+ * @brief Make an incremental reducer over given range.
+ *
+ * Elements changed through the reducer (or refreshed after being changed
+ * directly) cost O(log n) to account for, instead of a new O(n) reduction.
+ *
+ * @param fn Associative reduction function.
+ * @param range Non-empty random access range to reduce.
+ *
+ * @return Incremental reducer.
+ */
+template<class Fn, class Range>
+auto incremental( Fn fn, Range &&range ) {
+    auto r = detail::view( std::forward<Range>( range ) );
+    return IncrementalReducer<decltype( r ), Fn>( std::move( fn ), r );
+}
+
 /////////////////////////////////////////////////////////
 // Implementation of class items
 /////////////////////////////////////////////////////////
@@ -628,14 +2761,14 @@ GenericRange<I> detail::TilingIterator<I>::operator*() {
 template<class I>
 template<class Fn>
 void GenericRange<I>::each( Fn fn ) {
-    ::each( fn, *this );
+    ::each( std::move( fn ), *this );
 }
 
 template<class I>
 template<class Fn>
 GenericRange<detail::MapIterator<I, Fn> >
 GenericRange<I>::map( Fn fn ) {
-    return ::map( fn, *this );
+    return ::map( std::move( fn ), *this );
 }
 
 template<class I>
@@ -649,21 +2782,78 @@ template<class I>
 template<class Fn>
 GenericRange<detail::FilterIterator<I, Fn> >
 GenericRange<I>::filter( Fn fn ) {
-    return ::filter( fn, *this );
+    return ::filter( std::move( fn ), *this );
+}
+
+template<class I>
+GenericRange<detail::CachingIterator<I> >
+GenericRange<I>::cache( size_t capacity ) {
+    return ::cache( *this, capacity );
+}
+
+template<class I>
+template<class Fn>
+Selection GenericRange<I>::select( Fn fn ) {
+    return ::select( std::move( fn ), *this );
+}
+
+template<class I>
+template<class Range, class Cmp>
+auto GenericRange<I>::merge( Range other, Cmp cmp ) {
+    return ::merge( *this, std::move( other ), std::move( cmp ) );
+}
+
+template<class I>
+template<class Range, class Cmp>
+auto GenericRange<I>::setUnion( Range other, Cmp cmp ) {
+    return ::setUnion( *this, std::move( other ), std::move( cmp ) );
+}
+
+template<class I>
+template<class Range, class Cmp>
+auto GenericRange<I>::setIntersection( Range other, Cmp cmp ) {
+    return ::setIntersection( *this, std::move( other ), std::move( cmp ) );
+}
+
+template<class I>
+template<class Range, class Cmp>
+auto GenericRange<I>::setDifference( Range other, Cmp cmp ) {
+    return ::setDifference( *this, std::move( other ), std::move( cmp ) );
 }
 
 template<class I>
 template<class Fn>
 typename GenericRange<I>::value_type
 GenericRange<I>::reduce( Fn fn ) {
-    return ::reduce( fn, *this );
+    return ::reduce( std::move( fn ), *this );
 }
 
 template<class I>
 template<class Fn>
 typename GenericRange<I>::value_type
 GenericRange<I>::fold( Fn fn, typename GenericRange<I>::value_type init ) {
-    return ::fold( fn, init, *this );
+    return ::fold( std::move( fn ), init, *this );
+}
+
+template<class I>
+template<class Fn>
+GenericRange<detail::ScanIterator<I, Fn> >
+GenericRange<I>::scan( Fn fn, typename GenericRange<I>::value_type init ) {
+    return ::scan( std::move( fn ), init, *this );
+}
+
+template<class I>
+template<class Fn, class Out>
+typename GenericRange<I>::value_type
+GenericRange<I>::inclusiveScan( Fn fn, Out &&dest ) {
+    return ::inclusiveScan( std::move( fn ), *this, std::forward<Out>( dest ) );
+}
+
+template<class I>
+template<class Fn, class Out>
+typename GenericRange<I>::value_type
+GenericRange<I>::exclusiveScan( Fn fn, typename GenericRange<I>::value_type init, Out &&dest ) {
+    return ::exclusiveScan( std::move( fn ), init, *this, std::forward<Out>( dest ) );
 }
 
 template<class I>
@@ -685,24 +2875,14 @@ template<class I>
 template<class O>
 void GenericRange<I>::copyTo( GenericRange<O> other ) const {
     assert( this->size() == other.size() );
-    auto ti = _b;
-    auto oi = other.begin();
-
-    while( ti != _e ) {
-        *( oi++ ) = *( ti++ );
-    }
+    detail::copyRange( _b, _e, other.begin() );
 }
 
 template<class I>
 template<class Range>
 void GenericRange<I>::copyTo( Range &other ) const {
     assert( this->size() == other.size() );
-    auto ti = _b;
-    auto oi = other.begin();
-
-    while( ti != _e ) {
-        *( oi++ ) = *( ti++ );
-    }
+    detail::copyRange( _b, _e, other.begin() );
 }
 
 template<class I>
@@ -710,12 +2890,29 @@ auto GenericRange<I>::tile( size_t tile_length ) {
     return ::tile( *this, tile_length );
 }
 
+template<class I>
+auto GenericRange<I>::flatten() {
+    return ::flatten( *this );
+}
+
+template<class I>
+template<class T>
+auto GenericRange<I>::join( T separator ) {
+    return ::join( *this, separator );
+}
+
 template<class I>
 GenericRange<detail::SplitIterator<I> >
 GenericRange<I>::split( typename GenericRange<I>::value_type delimiter ) {
     return ::split( *this, delimiter );
 }
 
+template<class I>
+template<class Fn>
+auto GenericRange<I>::incremental( Fn fn ) {
+    return ::incremental( std::move( fn ), *this );
+}
+
 #undef ITERATOR_WRAPPER_COMPARISON_IMPL
 #undef RANDOM_ACCESS_ITERATOR_WRAPPER_IMPL
 
@@ -0,0 +1,119 @@
+#!/bin/sh
+#
+# Vectorization audit of range adapters.
+#
+# Compiles every kernel of src/audit.cpp twice - with range adapters, and as
+# the reference raw loop - with the compiler's optimization report enabled.
+# Reports whether loops vectorized and at what width, along with instruction
+# counts of the generated code. Fails when a kernel listed as `vector` in
+# tools/vecaudit.baseline compiles to scalar code.
+#
+# The verdict is per translation unit: a kernel counts as vectorized when
+# the report lists any vectorized loop located in src/ (loops of standard
+# headers are ignored). Each kernel is compiled alone, so those are loops of
+# the kernel and of the adapters it instantiates, but a vectorized helper
+# loop would hide a scalar main loop. Compare instruction counts against
+# the raw loop to spot that.
+#
+# Usage: CC=c++ CFLAGS="-O3 ..." tools/vecaudit.sh [kernel...]
+
+CC=${CC:-c++}
+CFLAGS=${CFLAGS:-"-O3 -std=c++14 -ffast-math -Wall -mtune=native"}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SRC="$ROOT/src/audit.cpp"
+BASELINE="$ROOT/tools/vecaudit.baseline"
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if $CC --version 2>/dev/null | grep -qi clang; then
+    REPORT="-Rpass=loop-vectorize"
+else
+    REPORT="-fopt-info-vec-optimized"
+fi
+
+# Compile a kernel and print "<vector|simd|scalar|error> <width> <instructions>".
+#
+# `vector` means the optimization report lists a vectorized loop, `simd` that
+# the report is silent, but packed arithmetic is present (e.g. intrinsics).
+analyze() {
+    define=AUDIT_$(echo "$1" | tr 'a-z' 'A-Z')
+    if ! $CC $CFLAGS -S -o "$TMP/kernel.s" "$SRC" -D "$define" $2 $REPORT > "$TMP/report" 2>&1; then
+        echo "error - -"
+        return
+    fi
+
+    awk -v src="$ROOT/src/" '
+        # optimization report: gcc reports bytes, clang reports lanes.
+        FILENAME ~ /report$/ {
+            if ( index( $0, src ) != 1 )
+                next
+            if ( match( $0, /loop vectorized using [0-9]+ byte vectors/ ) ) {
+                split( substr( $0, RSTART, RLENGTH ), w, " " )
+                loops++
+                if ( w[4] + 0 > bytes ) bytes = w[4] + 0
+            } else if ( match( $0, /vectorization width: [0-9]+/ ) ) {
+                split( substr( $0, RSTART, RLENGTH ), w, " " )
+                loops++
+                if ( w[3] + 0 > lanes ) lanes = w[3] + 0
+            }
+            next
+        }
+        # assembly: count instructions, and look for packed arithmetic.
+        /^\t[a-z]/ {
+            instructions++
+            if ( $1 ~ /^v?(add|sub|mul|div|min|max)p[sd]$/ || $1 ~ /^v?p(add|sub|mul|min|max|cmp)[a-z]*$/ ||
+                 $1 ~ /^v?cmp[a-z]*p[sd]$/ || $1 ~ /^vfn?m(add|sub)[0-9]+p[sd]$/ ) {
+                packed++
+                reg = $0 ~ /%zmm/ ? 64 : ( $0 ~ /%ymm/ ? 32 : 16 )
+                if ( reg > regbytes ) regbytes = reg
+            }
+        }
+        END {
+            if ( loops )
+                print "vector", ( bytes ? bytes "B" : lanes "x" ), instructions
+            else if ( packed )
+                print "simd", regbytes "B", instructions
+            else
+                print "scalar", "-", instructions
+        }
+    ' "$TMP/report" "$TMP/kernel.s"
+}
+
+kernels=$*
+if [ -z "$kernels" ]; then
+    kernels=$(awk '!/^#/ && NF { print $1 }' "$BASELINE")
+fi
+
+failed=0
+
+printf "%-18s %-22s %-22s %-8s %s\n" "kernel" "adapters" "raw loop" "expected" "status"
+
+for kernel in $kernels; do
+    expected=$(awk -v k="$kernel" '$1 == k { print $2 }' "$BASELINE")
+    set -- $(analyze "$kernel" "")
+    kind=$1 width=$2 insns=$3
+    set -- $(analyze "$kernel" "-D AUDIT_REFERENCE")
+    ref_kind=$1 ref_width=$2 ref_insns=$3
+
+    status=ok
+    if [ "$kind" = error ]; then
+        status=FAIL
+    elif [ "$kind" = scalar ] && [ "$expected" = vector ]; then
+        status=FAIL
+    elif [ "$kind" != scalar ] && [ "$expected" = scalar ]; then
+        status="improved, update baseline"
+    elif [ -z "$expected" ]; then
+        status="not in baseline"
+    fi
+    [ "$status" = FAIL ] && failed=1
+
+    printf "%-18s %-6s %-4s %5s insn   %-6s %-4s %5s insn   %-8s %s\n" \
+        "$kernel" "$kind" "$width" "$insns" "$ref_kind" "$ref_width" "$ref_insns" "${expected:--}" "$status"
+done
+
+if [ $failed -ne 0 ]; then
+    echo "vectorization audit failed" >&2
+    exit 1
+fi